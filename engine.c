@@ -0,0 +1,93 @@
+/*
+ * engine.c - The registry of allocator engines. The mm.c linked into
+ *     the driver is always there as "mm"; other engines are shared
+ *     objects loaded with dlopen. They are linked with -Bsymbolic, so
+ *     their own mm_* functions call each other and not the ones in the
+ *     driver, and they use the driver's memlib (mdriver is linked with
+ *     -rdynamic), so all engines run in the same simulated heap.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "engine.h"
+
+static mm_engine_t registry[MAX_ENGINES] = {
+	{"mm", mm_init, mm_malloc, mm_free, mm_realloc, mm_usable_size,
+	 mm_block_size, mm_freeinfo, mm_heap_walk, mm_get_stats, mm_set_params,
+	 mm_get_params, mm_sync, mm_memalign, NULL}};
+static int nregistered = 1;
+
+mm_engine_t *mm_engine = &registry[0];
+
+/*
+ * engine_name - "dir/engine-mm-buddy.so" -> "mm-buddy"
+ */
+static void engine_name(char *name, size_t len, const char *path)
+{
+	const char *base = strrchr(path, '/');
+	size_t n;
+
+	base = base ? base + 1 : path;
+	if (strncmp(base, "engine-", 7) == 0)
+		base += 7;
+	n = strlen(base);
+	if (n > 3 && strcmp(base + n - 3, ".so") == 0)
+		n -= 3;
+	if (n >= len)
+		n = len - 1;
+	memcpy(name, base, n);
+	name[n] = '\0';
+}
+
+/*
+ * engine_load - dlopen path and fill in e from its mm.h symbols
+ */
+static int engine_load(mm_engine_t *e, const char *path)
+{
+	void *h;
+
+	if ((h = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL)
+	{
+		fprintf(stderr, "engine: %s\n", dlerror());
+		return -1;
+	}
+	memset(e, 0, sizeof(*e));
+	engine_name(e->name, sizeof(e->name), path);
+	e->handle = h;
+	*(void **)&e->init = dlsym(h, "mm_init");
+	*(void **)&e->malloc = dlsym(h, "mm_malloc");
+	*(void **)&e->free = dlsym(h, "mm_free");
+	*(void **)&e->realloc = dlsym(h, "mm_realloc");
+	*(void **)&e->usable_size = dlsym(h, "mm_usable_size");
+	*(void **)&e->block_size = dlsym(h, "mm_block_size");
+	*(void **)&e->freeinfo = dlsym(h, "mm_freeinfo");
+	*(void **)&e->heap_walk = dlsym(h, "mm_heap_walk");
+	*(void **)&e->get_stats = dlsym(h, "mm_get_stats");
+	*(void **)&e->set_params = dlsym(h, "mm_set_params");
+	*(void **)&e->get_params = dlsym(h, "mm_get_params");
+	*(void **)&e->sync = dlsym(h, "mm_sync");
+	*(void **)&e->memalign = dlsym(h, "mm_memalign");
+	if (!e->init || !e->malloc || !e->free || !e->realloc)
+	{
+		fprintf(stderr, "engine: %s lacks mm_init/mm_malloc/mm_free/mm_realloc\n",
+				path);
+		dlclose(h);
+		return -1;
+	}
+	return 0;
+}
+
+mm_engine_t *engine_get(const char *name)
+{
+	if (strcmp(name, "mm") == 0)
+		return &registry[0];
+	if (nregistered == MAX_ENGINES)
+	{
+		fprintf(stderr, "engine: at most %d engines\n", MAX_ENGINES);
+		return NULL;
+	}
+	if (engine_load(&registry[nregistered], name) < 0)
+		return NULL;
+	return &registry[nregistered++];
+}
@@ -0,0 +1,46 @@
+#ifndef __ENGINE_H_
+#define __ENGINE_H_
+
+#include "mm.h"
+
+/*
+ * engine.h - allocator engines for mdriver: the mm.h interface as a
+ *     table of function pointers, so one driver run can test several
+ *     allocators on the same traces
+ */
+
+#define MAX_ENGINES 16
+
+typedef struct
+{
+	char name[64];
+	/* required */
+	int (*init)(void);
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+	/* optional, NULL if the engine doesn't have them */
+	size_t (*usable_size)(void *ptr);
+	size_t (*block_size)(size_t size);
+	void (*freeinfo)(size_t *nfree, size_t *free_bytes, size_t *largest);
+	void (*heap_walk)(mm_walk_fn fn, void *arg);
+	int (*get_stats)(mm_stats_t *st);
+	int (*set_params)(const mm_params_t *p);
+	void (*get_params)(mm_params_t *p);
+	void (*sync)(void);
+	void *(*memalign)(size_t align, size_t size);
+	void *handle; /* dlopen handle, NULL for the linked-in engine */
+} mm_engine_t;
+
+/* The engine the driver is currently testing */
+extern mm_engine_t *mm_engine;
+
+/*
+ * engine_get - "mm" is the mm.c linked into the driver; anything else
+ *     is the path of a shared object that defines the mm.h functions
+ *     (make engine-<file>.so), which is loaded and registered. Returns
+ *     NULL on error.
+ */
+mm_engine_t *engine_get(const char *name);
+
+#endif /* __ENGINE_H_ */
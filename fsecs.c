@@ -1,7 +1,11 @@
 /****************************
  * High-level timing wrappers
  ****************************/
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sched.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -10,8 +14,30 @@
 
 static double Mhz;  /* estimated CPU clock frequency */
 
+/* Parameters of the clock_gettime timer */
+static int pin_cpu = -1;      /* CPU to run on (-1 = any) */
+static int warmup = 1;        /* untimed runs before sampling */
+static int reps = 10;         /* timed runs per measurement */
+static int kbest = 0;         /* K in K-best scheme (0 = use the median) */
+
 extern int verbose; /* -v option in mdriver.c */
 
+/*
+ * fsecs_pin - Pin the calling process to one CPU, so that the timed
+ *     runs don't migrate between cores (and their caches) mid-trace
+ */
+void fsecs_pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+	perror("fsecs_pin: sched_setaffinity");
+	exit(1);
+    }
+}
+
 /*
  * init_fsecs - initialize the timing package
  */
@@ -36,22 +62,186 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_CLOCK
+    if (pin_cpu >= 0)
+	fsecs_pin(pin_cpu);
+    if (verbose) {
+	printf("Measuring performance with clock_gettime(): ");
+	printf("%d warmup + %d timed runs, ", warmup, reps);
+	if (kbest > 0)
+	    printf("mean of %d best", kbest);
+	else
+	    printf("median");
+	if (pin_cpu >= 0)
+	    printf(", pinned to CPU %d", pin_cpu);
+	printf(".\n");
+    }
 #endif
 }
 
+#if USE_CLOCK
+/* 
+ * t95 - two-sided 95% quantile of Student's t with df degrees of freedom 
+ */
+static double t95(int df)
+{
+    static const double t[] = {
+	0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+	2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+	2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+	2.048, 2.045, 2.042
+    };
+
+    if (df < 1)
+	return 0;
+    return (df <= 30) ? t[df] : 1.960;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * clock_estimate - Reduce n sorted samples to one running time, and
+ *     the half-width of its 95% confidence interval in *ci.
+ *     K-best: mean of the k fastest runs, t-interval over those runs.
+ *     Median: distribution-free interval from the order statistics
+ *     at ranks n/2 -+ 1.96*sqrt(n)/2.
  */
-double fsecs(fsecs_test_funct f, void *argp) 
+static double clock_estimate(double *s, int n, double *ci)
 {
+    double est;
+    int i;
+
+    if (kbest > 0) {
+	int k = (kbest < n) ? kbest : n;
+	double sum = 0, ss = 0;
+
+	for (i = 0; i < k; i++)
+	    sum += s[i];
+	est = sum / k;
+	for (i = 0; i < k; i++)
+	    ss += (s[i] - est) * (s[i] - est);
+	*ci = (k > 1) ? t95(k - 1) * sqrt(ss / (k - 1)) / sqrt(k) : 0;
+    }
+    else {
+	int lo = (int)floor(n / 2.0 - 0.98 * sqrt(n));
+	int hi = (int)ceil(n / 2.0 + 0.98 * sqrt(n));
+
+	if (lo < 0) lo = 0;
+	if (hi > n - 1) hi = n - 1;
+	est = (n % 2) ? s[n/2] : (s[n/2 - 1] + s[n/2]) / 2;
+	*ci = (s[hi] - est > est - s[lo]) ? s[hi] - est : est - s[lo];
+    }
+    return est;
+}
+#endif
+
+/*
+ * fsecs_ci - Return the running time of a function f (in seconds),
+ *     and the half-width of its 95% confidence interval in *ci
+ *     (0 if the timer can't tell). ci may be NULL.
+ */
+double fsecs_ci(fsecs_test_funct f, void *argp, double *ci) 
+{
+    double dummy;
+
+    if (ci == NULL)
+	ci = &dummy;
+    *ci = 0;
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    return ftimer_itimer(f, argp, reps);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    return ftimer_gettod(f, argp, reps);
+#elif USE_CLOCK
+    double *samples, est;
+
+    if ((samples = malloc(reps * sizeof(double))) == NULL) {
+	fprintf(stderr, "fsecs: malloc failed\n");
+	exit(1);
+    }
+    ftimer_clock(f, argp, warmup, reps, samples);
+    qsort(samples, reps, sizeof(double), cmp_double);
+    est = clock_estimate(samples, reps, ci);
+    free(samples);
+    return est;
 #endif 
 }
 
+/*
+ * fsecs_interleaved - Time f on each of argps[0..n-1], like fsecs_ci,
+ *     but take the timed runs round-robin (starting one further along
+ *     each round), so that drift in the machine's speed hits all of
+ *     them alike. The other timers just time one after the other.
+ */
+void fsecs_interleaved(fsecs_test_funct f, void **argps, int n,
+		       double *secs, double *ci)
+{
+    int i;
+#if USE_CLOCK
+    double *samples;
+    int r;
+
+    if ((samples = malloc(n * reps * sizeof(double))) == NULL) {
+	fprintf(stderr, "fsecs: malloc failed\n");
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	ftimer_clock(f, argps[i], warmup, 0, NULL);
+    for (r = 0; r < reps; r++)
+	for (i = 0; i < n; i++) {
+	    int j = (r + i) % n;
+	    ftimer_clock(f, argps[j], 0, 1, &samples[j * reps + r]);
+	}
+    for (i = 0; i < n; i++) {
+	qsort(samples + i * reps, reps, sizeof(double), cmp_double);
+	secs[i] = clock_estimate(samples + i * reps, reps, &ci[i]);
+    }
+    free(samples);
+#else
+    for (i = 0; i < n; i++)
+	secs[i] = fsecs_ci(f, argps[i], &ci[i]);
+#endif
+}
+
+/*
+ * fsecs - Return the running time of a function f (in seconds)
+ */
+double fsecs(fsecs_test_funct f, void *argp) 
+{
+    return fsecs_ci(f, argp, NULL);
+}
+
+/*******************************************************
+ * Set the parameters used by the clock_gettime timer
+ *******************************************************/
 
+/* set_fsecs_cpu - Pin the process to this CPU in init_fsecs (-1 = don't) */
+void set_fsecs_cpu(int cpu)
+{
+    pin_cpu = cpu;
+}
+
+/* set_fsecs_warmup - Number of untimed runs before sampling. Default = 1 */
+void set_fsecs_warmup(int warmup_arg)
+{
+    warmup = (warmup_arg < 0) ? 0 : warmup_arg;
+}
+
+/* set_fsecs_reps - Number of timed runs per measurement. Default = 10 */
+void set_fsecs_reps(int reps_arg)
+{
+    reps = (reps_arg < 1) ? 1 : reps_arg;
+}
+
+/* set_fsecs_kbest - Report the mean of the k fastest runs (0 = median).
+ *     Default = 0 */
+void set_fsecs_kbest(int k)
+{
+    kbest = (k < 0) ? 0 : k;
+}
@@ -1,4 +1,16 @@
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_ci(fsecs_test_funct f, void *argp, double *ci);
+void fsecs_interleaved(fsecs_test_funct f, void **argps, int n,
+		       double *secs, double *ci);
+void fsecs_pin(int cpu);
+
+/* Timer parameters. set_fsecs_reps applies to every timer but fcyc,
+   which has its own; the others only to the USE_CLOCK timer. */
+void set_fsecs_reps(int reps);     /* timed runs per measurement */
+void set_fsecs_cpu(int cpu);       /* pin to this CPU, -1 = don't pin */
+void set_fsecs_warmup(int warmup); /* untimed runs before sampling */
+void set_fsecs_kbest(int k);       /* mean of the k fastest runs, 0 = median */
@@ -7,8 +7,10 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock: version that uses clock_gettime and keeps every sample
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
@@ -52,6 +54,37 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/*
+ * Use the raw hardware clock when the kernel offers it: unlike
+ * CLOCK_MONOTONIC it is not slewed by NTP while we are measuring.
+ */
+#ifdef CLOCK_MONOTONIC_RAW
+#define FTIMER_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define FTIMER_CLOCK CLOCK_MONOTONIC
+#endif
+
+/* 
+ * ftimer_clock - Use clock_gettime to time f(argp). The first warmup
+ * runs are discarded (they fault in the heap and warm the caches);
+ * the running time of each of the next n runs is stored in samples[].
+ */
+void ftimer_clock(ftimer_test_funct f, void *argp, int warmup, int n,
+		  double *samples)
+{
+    int i;
+    struct timespec sts, ets;
+
+    for (i = 0; i < warmup; i++)
+	f(argp);
+    for (i = 0; i < n; i++) {
+	clock_gettime(FTIMER_CLOCK, &sts);
+	f(argp);
+	clock_gettime(FTIMER_CLOCK, &ets);
+	samples[i] = (double)(ets.tv_sec - sts.tv_sec) + 
+	    1E-9*(ets.tv_nsec - sts.tv_nsec);
+    }
+}
 
 /*
  * Routines for manipulating the Unix interval timer
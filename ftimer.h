@@ -12,3 +12,8 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Estimate the running time of f(argp) using clock_gettime.
+   Run f warmup times untimed, then store the time of each of the
+   next n runs in samples[0..n-1] */
+void ftimer_clock(ftimer_test_funct f, void *argp, int warmup, int n,
+		  double *samples);
@@ -0,0 +1,529 @@
+/*
+ * gentrace.c - Parameterized workload generator for Malloc Lab traces
+ *
+ * Replaces the fixed-pattern gen_*.pl scripts in traces/. A workload is
+ * a sequence of phases; each phase makes a number of allocations whose
+ * sizes and lifetimes (in trace ops) come from the given distributions.
+ * A fraction of the blocks grow through a chain of reallocs. Output is
+ * a balanced trace that read_trace and checktrace.pl accept, and the
+ * same seed always gives the same trace.
+ *
+ * Memory use is bounded by the number of live blocks, not the trace
+ * length, so traces of any length can be generated.
+ *
+ *   unix> gentrace -n 100000 -S powerlaw:16:65536:1.5 -L exp:500 -o big.rep
+ *   unix> gentrace -p 50000,bimodal:24:4072:0.9,exp:200 \
+ *                  -p 50000,uniform:1:512,forever -o phases.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+
+#define MAXLINE 1024
+#define MAXPHASES 64
+#define MAXSIZE (INT_MAX / 2) /* read_trace keeps sizes in an int */
+
+/* A size or lifetime distribution */
+typedef struct
+{
+	enum
+	{
+		D_FIXED,
+		D_UNIFORM,
+		D_POWERLAW,
+		D_BIMODAL,
+		D_EXP,
+		D_HIST,
+		D_FOREVER
+	} kind;
+	double a, b, c; /* parameters, see parse_dist */
+	int nbins;		/* D_HIST: histogram bins ... */
+	double *val;	/* ... their values ... */
+	double *cum;	/* ... and cumulative weights */
+} dist_t;
+
+/* One phase of the workload */
+typedef struct
+{
+	long allocs;		 /* number of allocations */
+	dist_t size;		 /* request sizes in bytes */
+	dist_t life;		 /* lifetimes in trace ops */
+	double realloc_prob; /* chance that a block grows by realloc ... */
+	double growth;		 /* ... by this factor per step ... */
+	int chain;			 /* ... this many times */
+} phase_t;
+
+/* A pending free or realloc, kept in a min-heap by trace op */
+typedef struct
+{
+	uint64_t when; /* trace op at which it happens */
+	int id;		   /* block id */
+	int step;	   /* realloc step (0 = free) */
+} event_t;
+
+static uint64_t rng_state;
+static event_t *heap = NULL;
+static long heap_len = 0, heap_max = 0;
+
+static void usage(void);
+static void app_error(char *msg);
+
+/***************************
+ * Pseudo-random numbers
+ ***************************/
+
+/* splitmix64: tiny, fast, and fully determined by the seed */
+static uint64_t rng_next(void)
+{
+	uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* Uniform double in (0, 1) */
+static double rng_unit(void)
+{
+	return ((rng_next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/***************************
+ * Distributions
+ ***************************/
+
+/*
+ * load_hist - Read a histogram file of "<value> <weight>" lines
+ */
+static void load_hist(dist_t *d, const char *path)
+{
+	FILE *fp;
+	double v, w, sum = 0;
+	int max = 0;
+
+	if ((fp = fopen(path, "r")) == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	d->nbins = 0;
+	while (fscanf(fp, "%lf %lf", &v, &w) == 2)
+	{
+		if (w <= 0)
+			continue;
+		if (d->nbins == max)
+		{
+			max = max ? 2 * max : 64;
+			d->val = realloc(d->val, max * sizeof(double));
+			d->cum = realloc(d->cum, max * sizeof(double));
+			if (d->val == NULL || d->cum == NULL)
+				app_error("realloc failed in load_hist");
+		}
+		sum += w;
+		d->val[d->nbins] = v;
+		d->cum[d->nbins] = sum;
+		d->nbins++;
+	}
+	fclose(fp);
+	if (d->nbins == 0)
+		app_error("empty histogram");
+}
+
+/*
+ * parse_dist - Parse a distribution spec:
+ *     fixed:V                 always V
+ *     uniform:LO:HI           uniform on [LO, HI]
+ *     powerlaw:LO:HI:ALPHA    density ~ x^-ALPHA on [LO, HI]
+ *     bimodal:A:B:P           A with probability P, else B
+ *     exp:MEAN                exponential with mean MEAN
+ *     hist:FILE               "<value> <weight>" lines in FILE
+ *     forever                 (lifetimes) live until the end of the trace
+ */
+static void parse_dist(dist_t *d, const char *spec)
+{
+	char kind[MAXLINE];
+	const char *args = strchr(spec, ':');
+	int n = 0;
+
+	memset(d, 0, sizeof(*d));
+	snprintf(kind, MAXLINE, "%.*s", args ? (int)(args - spec) : MAXLINE - 1, spec);
+	if (args)
+		args++;
+
+	if (!strcmp(kind, "fixed"))
+		d->kind = D_FIXED, n = sscanf(args ? args : "", "%lf", &d->a) - 1;
+	else if (!strcmp(kind, "uniform"))
+		d->kind = D_UNIFORM, n = sscanf(args ? args : "", "%lf:%lf", &d->a, &d->b) - 2;
+	else if (!strcmp(kind, "powerlaw"))
+		d->kind = D_POWERLAW,
+		n = sscanf(args ? args : "", "%lf:%lf:%lf", &d->a, &d->b, &d->c) - 3;
+	else if (!strcmp(kind, "bimodal"))
+		d->kind = D_BIMODAL,
+		n = sscanf(args ? args : "", "%lf:%lf:%lf", &d->a, &d->b, &d->c) - 3;
+	else if (!strcmp(kind, "exp"))
+		d->kind = D_EXP, n = sscanf(args ? args : "", "%lf", &d->a) - 1;
+	else if (!strcmp(kind, "hist") && args)
+		d->kind = D_HIST, load_hist(d, args);
+	else if (!strcmp(kind, "forever"))
+		d->kind = D_FOREVER;
+	else
+		n = -1;
+
+	if (n != 0 || ((d->kind == D_UNIFORM || d->kind == D_POWERLAW) && d->a > d->b) ||
+		(d->kind == D_POWERLAW && d->a <= 0))
+	{
+		fprintf(stderr, "gentrace: bad distribution '%s'\n", spec);
+		usage();
+		exit(1);
+	}
+}
+
+/*
+ * sample - Draw one value from a distribution
+ */
+static double sample(dist_t *d)
+{
+	double u = rng_unit();
+	int lo, hi, mid;
+
+	switch (d->kind)
+	{
+	case D_FIXED:
+		return d->a;
+	case D_UNIFORM:
+		return d->a + floor(u * (d->b - d->a + 1));
+	case D_POWERLAW:
+		if (fabs(d->c - 1.0) < 1e-9)
+			return floor(d->a * pow(d->b / d->a, u));
+		else
+		{
+			double e = 1.0 - d->c;
+			double x0 = pow(d->a, e), x1 = pow(d->b, e);
+			return floor(pow(x0 + u * (x1 - x0), 1.0 / e));
+		}
+	case D_BIMODAL:
+		return (u < d->c) ? d->a : d->b;
+	case D_EXP:
+		return floor(-d->a * log(u));
+	case D_HIST:
+		u *= d->cum[d->nbins - 1];
+		for (lo = 0, hi = d->nbins - 1; lo < hi;)
+		{
+			mid = (lo + hi) / 2;
+			if (d->cum[mid] < u)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return d->val[lo];
+	case D_FOREVER:
+		return -1;
+	}
+	return 0;
+}
+
+/***************************
+ * The event heap
+ ***************************/
+
+/*
+ * before - Event order: by op, then by id so the output only depends on
+ *     the seed, then a block's realloc steps before its free
+ */
+static int before(event_t *a, event_t *b)
+{
+	if (a->when != b->when)
+		return a->when < b->when;
+	if (a->id != b->id)
+		return a->id < b->id;
+	return (a->step ? a->step : INT_MAX) < (b->step ? b->step : INT_MAX);
+}
+
+static void heap_push(uint64_t when, int id, int step)
+{
+	event_t e = {when, id, step};
+	long i = heap_len++;
+
+	if (heap_len > heap_max)
+	{
+		heap_max = heap_max ? 2 * heap_max : 1024;
+		if ((heap = realloc(heap, heap_max * sizeof(event_t))) == NULL)
+			app_error("realloc failed in heap_push");
+	}
+	for (; i > 0 && before(&e, &heap[(i - 1) / 2]); i = (i - 1) / 2)
+		heap[i] = heap[(i - 1) / 2];
+	heap[i] = e;
+}
+
+static event_t heap_pop(void)
+{
+	event_t top = heap[0], last = heap[--heap_len];
+	long i = 0, c;
+
+	while ((c = 2 * i + 1) < heap_len)
+	{
+		if (c + 1 < heap_len && before(&heap[c + 1], &heap[c]))
+			c++;
+		if (!before(&heap[c], &last))
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+	return top;
+}
+
+/***************************
+ * Trace generation
+ ***************************/
+
+/* Sizes of the live blocks and the phases that made them, by id */
+static int *cur_size = NULL;
+static phase_t **cur_phase = NULL;
+static long cur_max = 0;
+
+static uint64_t t = 0;	   /* ops written so far */
+static uint64_t live = 0;  /* live payload bytes */
+static uint64_t peak = 0;  /* peak live payload bytes */
+
+static int clamp_size(double s)
+{
+	if (s < 1)
+		return 1;
+	if (s > MAXSIZE)
+		return MAXSIZE;
+	return (int)s;
+}
+
+/*
+ * run_event - Write one pending free or realloc step
+ */
+static void run_event(FILE *out, event_t e)
+{
+	phase_t *ph = cur_phase[e.id];
+
+	if (e.step == 0)
+	{
+		fprintf(out, "f %d\n", e.id);
+		live -= cur_size[e.id];
+	}
+	else
+	{
+		int size = clamp_size(ceil(cur_size[e.id] * ph->growth));
+		fprintf(out, "r %d %d\n", e.id, size);
+		live += size - cur_size[e.id];
+		cur_size[e.id] = size;
+		if (live > peak)
+			peak = live;
+	}
+	t++;
+}
+
+/*
+ * gen_phase - Write the ops of one phase. Blocks that outlive the phase
+ *     keep the realloc growth factor of the phase that made them.
+ */
+static int gen_phase(FILE *out, phase_t *ph, int nids)
+{
+	long i;
+	int id, k, size;
+	double life;
+
+	for (i = 0; i < ph->allocs; i++)
+	{
+		while (heap_len > 0 && heap[0].when <= t)
+			run_event(out, heap_pop());
+
+		id = nids++;
+		if (id >= cur_max)
+		{
+			cur_max = cur_max ? 2 * cur_max : 4096;
+			cur_size = realloc(cur_size, cur_max * sizeof(int));
+			cur_phase = realloc(cur_phase, cur_max * sizeof(phase_t *));
+			if (cur_size == NULL || cur_phase == NULL)
+				app_error("realloc failed in gen_phase");
+		}
+		size = clamp_size(sample(&ph->size));
+		cur_size[id] = size;
+		cur_phase[id] = ph;
+		fprintf(out, "a %d %d\n", id, size);
+		live += size;
+		if (live > peak)
+			peak = live;
+		t++;
+
+		/* Schedule the reallocs evenly over the lifetime, then the free */
+		life = sample(&ph->life);
+		if (life < 0)
+			life = (double)UINT64_MAX / 4;
+		if (ph->chain > 0 && rng_unit() < ph->realloc_prob)
+			for (k = 1; k <= ph->chain; k++)
+				heap_push(t + (uint64_t)(life * k / (ph->chain + 1)), id, k);
+		heap_push(t + (uint64_t)life, id, 0);
+	}
+	return nids;
+}
+
+/*
+ * parse_phase - Parse "ALLOCS,SIZE,LIFE[,PROB:GROWTH:CHAIN]"
+ */
+static void parse_phase(phase_t *ph, char *spec, const char *realloc_spec)
+{
+	char *f[4], *tok;
+	int n = 0;
+
+	for (tok = strtok(spec, ","); tok != NULL; tok = strtok(NULL, ","))
+	{
+		if (n == 4)
+		{
+			n = 0;
+			break;
+		}
+		f[n++] = tok;
+	}
+	if (n < 3)
+	{
+		fprintf(stderr, "gentrace: bad phase '%s'\n", spec);
+		usage();
+		exit(1);
+	}
+	ph->allocs = atol(f[0]);
+	parse_dist(&ph->size, f[1]);
+	parse_dist(&ph->life, f[2]);
+	if (n == 4)
+		realloc_spec = f[3];
+	ph->realloc_prob = 0;
+	ph->growth = 1;
+	ph->chain = 0;
+	if (realloc_spec && sscanf(realloc_spec, "%lf:%lf:%d", &ph->realloc_prob,
+							   &ph->growth, &ph->chain) != 3)
+	{
+		fprintf(stderr, "gentrace: bad realloc spec '%s'\n", realloc_spec);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	phase_t phases[MAXPHASES];
+	char *phase_specs[MAXPHASES];
+	int nphases = 0;
+	long allocs = 10000;
+	char *size_spec = "uniform:1:4096";
+	char *life_spec = "exp:1000";
+	char *realloc_spec = NULL;
+	char *outfile = NULL;
+	uint64_t seed = 1;
+	FILE *body, *out;
+	char buf[1 << 16];
+	size_t n;
+	int i, c, nids = 0;
+
+	while ((c = getopt(argc, argv, "n:s:S:L:r:p:o:h")) != EOF)
+	{
+		switch (c)
+		{
+		case 'n': /* Number of allocations (single phase) */
+			allocs = atol(optarg);
+			break;
+		case 's': /* Random seed */
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'S': /* Size distribution (single phase) */
+			size_spec = optarg;
+			break;
+		case 'L': /* Lifetime distribution (single phase) */
+			life_spec = optarg;
+			break;
+		case 'r': /* Realloc chains PROB:GROWTH:CHAIN */
+			realloc_spec = optarg;
+			break;
+		case 'p': /* Add a phase */
+			if (nphases == MAXPHASES)
+				app_error("too many phases");
+			phase_specs[nphases++] = optarg;
+			break;
+		case 'o': /* Output file */
+			outfile = optarg;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	if (nphases == 0)
+	{
+		static char spec[3 * MAXLINE];
+		snprintf(spec, sizeof(spec), "%ld,%s,%s", allocs, size_spec, life_spec);
+		phase_specs[nphases++] = spec;
+	}
+	for (i = 0; i < nphases; i++)
+		parse_phase(&phases[i], phase_specs[i], realloc_spec);
+
+	/*
+	 * The header needs the op and id counts, so the ops go to a
+	 * temporary file first
+	 */
+	rng_state = seed;
+	if ((body = tmpfile()) == NULL)
+		app_error("tmpfile failed");
+	for (i = 0; i < nphases; i++)
+		nids = gen_phase(body, &phases[i], nids);
+	while (heap_len > 0)
+		run_event(body, heap_pop());
+
+	if (outfile == NULL)
+		out = stdout;
+	else if ((out = fopen(outfile, "w")) == NULL)
+	{
+		perror(outfile);
+		exit(1);
+	}
+	fprintf(out, "%llu\n%d\n%llu\n1\n", (unsigned long long)peak, nids,
+			(unsigned long long)t);
+	rewind(body);
+	while ((n = fread(buf, 1, sizeof(buf), body)) > 0)
+		fwrite(buf, 1, n, out);
+	fclose(body);
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+	fprintf(stderr, "gentrace: %s\n", msg);
+	exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: gentrace [-h] [-n <allocs>] [-S <size>] [-L <life>] [-r <realloc>]\n");
+	fprintf(stderr, "                [-p <phase>]... [-s <seed>] [-o <file>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+	fprintf(stderr, "\t-n <allocs>  Number of allocations (default 10000).\n");
+	fprintf(stderr, "\t-S <dist>    Request size distribution (default uniform:1:4096).\n");
+	fprintf(stderr, "\t-L <dist>    Lifetime distribution in ops (default exp:1000).\n");
+	fprintf(stderr, "\t-r <p:g:n>   A fraction p of blocks grows by factor g, n times.\n");
+	fprintf(stderr, "\t-p <phase>   Add a phase <allocs>,<size>,<life>[,<p:g:n>];\n");
+	fprintf(stderr, "\t             phases run in order and replace -n/-S/-L.\n");
+	fprintf(stderr, "\t-s <seed>    Random seed (default 1).\n");
+	fprintf(stderr, "\t-o <file>    Write the trace to <file> instead of stdout.\n");
+	fprintf(stderr, "Distributions\n");
+	fprintf(stderr, "\tfixed:V  uniform:LO:HI  powerlaw:LO:HI:ALPHA  bimodal:A:B:P\n");
+	fprintf(stderr, "\texp:MEAN  hist:FILE (\"<value> <weight>\" lines)  forever\n");
+}
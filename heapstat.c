@@ -0,0 +1,238 @@
+/*
+ * heapstat.c - Analyze the heap that mm.c builds: where the bytes go
+ *     (payload, header/footer overhead, rounding, unsplit leftovers,
+ *     free space), how the free space is spread over size classes, and
+ *     a picture of the heap as a PPM image.
+ *
+ * The heap is walked through the engine under test (engine.h).
+ * The allocator only knows block sizes; the requested sizes come from
+ * the driver, which passes its per-id arrays of live blocks. Both are
+ * matched up by walking the blocks and the sorted live list together.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "heapstat.h"
+#include "engine.h"
+
+#define MAP_WIDTH 512 /* pixels per row of the heap map */
+#define MAP_UNIT 16	  /* heap bytes per pixel */
+
+/* One live block as the driver sees it */
+typedef struct
+{
+	char *p;
+	size_t size;
+} live_t;
+
+/* State threaded through mm_heap_walk */
+typedef struct
+{
+	live_t *live; /* live blocks sorted by address */
+	int nlive;
+	int next;			  /* first live block not yet matched */
+	heapstat_t *hs;		  /* collect: the stats */
+	unsigned char *image; /* map: the pixels */
+} walk_t;
+
+static const unsigned char color_free[3] = {0xd8, 0xd8, 0xd8};
+static const unsigned char color_payload[3] = {0x30, 0x60, 0xc0};
+static const unsigned char color_slack[3] = {0xe0, 0x80, 0x30};
+
+static int cmp_live(const void *a, const void *b)
+{
+	const live_t *x = a, *y = b;
+	return (x->p > y->p) - (x->p < y->p);
+}
+
+/*
+ * init_walk - Sort the live blocks of the driver by address
+ */
+static int init_walk(walk_t *w, char **blocks, size_t *sizes, int n)
+{
+	int i;
+
+	memset(w, 0, sizeof(*w));
+	if ((w->live = malloc((n ? n : 1) * sizeof(live_t))) == NULL)
+		return -1;
+	for (i = 0; i < n; i++)
+		if (blocks[i] != NULL)
+		{
+			w->live[w->nlive].p = blocks[i];
+			w->live[w->nlive].size = sizes[i];
+			w->nlive++;
+		}
+	qsort(w->live, w->nlive, sizeof(live_t), cmp_live);
+	return 0;
+}
+
+/*
+ * requested - The requested size of the allocated block at bp
+ */
+static size_t requested(walk_t *w, char *bp)
+{
+	while (w->next < w->nlive && w->live[w->next].p < bp)
+		w->next++;
+	if (w->next < w->nlive && w->live[w->next].p == bp)
+		return w->live[w->next++].size;
+	return 0;
+}
+
+static void collect_block(void *blk, void *bp, size_t size, int alloc, void *arg)
+{
+	walk_t *w = arg;
+	heapstat_t *hs = w->hs;
+	size_t req, need;
+	int c;
+
+	if (alloc)
+	{
+		req = requested(w, bp);
+		need = mm_engine->block_size(req ? req : 1);
+		hs->nalloc++;
+		hs->payload += req;
+		hs->overhead += size - mm_engine->usable_size(bp);
+		hs->rounding += need - (size - mm_engine->usable_size(bp)) - req;
+		hs->unsplit += size - need;
+	}
+	else
+	{
+		hs->nfree++;
+		hs->free_bytes += size;
+		if (size > hs->largest)
+			hs->largest = size;
+		for (c = 0; c < HS_NCLASSES - 1 && (size >> (HS_MINCLASS + c + 1)) > 0; c++)
+			;
+		hs->class_count[c]++;
+		hs->class_bytes[c] += size;
+	}
+}
+
+/*
+ * heapstat_collect - Walk the heap and fill in hs
+ */
+int heapstat_collect(heapstat_t *hs, char **blocks, size_t *sizes, int n)
+{
+	walk_t w;
+
+	if (init_walk(&w, blocks, sizes, n) < 0)
+		return -1;
+	memset(hs, 0, sizeof(*hs));
+	hs->heap = mem_heapsize();
+	w.hs = hs;
+	mm_engine->heap_walk(collect_block, &w);
+	free(w.live);
+	return 0;
+}
+
+static void percent(FILE *fp, const char *what, size_t bytes, size_t heap)
+{
+	fprintf(fp, "  %-10s%12lu %6.1f%%\n", what, (unsigned long)bytes,
+			heap ? 100.0 * bytes / heap : 0);
+}
+
+/*
+ * heapstat_print - Print where the bytes of the heap went
+ */
+void heapstat_print(FILE *fp, heapstat_t *hs)
+{
+	int c;
+
+	fprintf(fp, "  %lu bytes, %lu allocated and %lu free blocks\n",
+			(unsigned long)hs->heap, (unsigned long)hs->nalloc,
+			(unsigned long)hs->nfree);
+	percent(fp, "payload", hs->payload, hs->heap);
+	percent(fp, "overhead", hs->overhead, hs->heap);
+	percent(fp, "rounding", hs->rounding, hs->heap);
+	percent(fp, "unsplit", hs->unsplit, hs->heap);
+	percent(fp, "free", hs->free_bytes, hs->heap);
+	fprintf(fp, "  largest free block %lu, external fragmentation %.1f%%\n",
+			(unsigned long)hs->largest,
+			hs->free_bytes ? 100.0 * (1.0 - (double)hs->largest / hs->free_bytes) : 0);
+	if (hs->nfree == 0)
+		return;
+	fprintf(fp, "  %-20s%8s%12s\n", "free size class", "blocks", "bytes");
+	for (c = 0; c < HS_NCLASSES; c++)
+	{
+		char range[32];
+
+		if (hs->class_count[c] == 0)
+			continue;
+		if (c < HS_NCLASSES - 1)
+			sprintf(range, "%lu-%lu", 1UL << (HS_MINCLASS + c),
+					(1UL << (HS_MINCLASS + c + 1)) - 1);
+		else
+			sprintf(range, "%lu+", 1UL << (HS_MINCLASS + c));
+		fprintf(fp, "  %-20s%8lu%12lu\n", range,
+				(unsigned long)hs->class_count[c], (unsigned long)hs->class_bytes[c]);
+	}
+}
+
+static void paint(walk_t *w, char *lo, char *hi, const unsigned char *color)
+{
+	char *base = mem_heap_lo();
+	size_t px;
+
+	for (px = (lo - base) / MAP_UNIT; px < (size_t)(hi - base + MAP_UNIT - 1) / MAP_UNIT; px++)
+		memcpy(w->image + 3 * px, color, 3);
+}
+
+static void map_block(void *blk, void *bp, size_t size, int alloc, void *arg)
+{
+	walk_t *w = arg;
+	size_t req;
+
+	if (!alloc)
+	{
+		paint(w, blk, (char *)blk + size, color_free);
+		return;
+	}
+	req = requested(w, bp);
+	paint(w, blk, (char *)blk + size, color_slack);
+	paint(w, bp, (char *)bp + req, color_payload);
+}
+
+/*
+ * heapstat_map - Write the heap as a binary PPM image, one pixel per
+ *     MAP_UNIT bytes, rows of MAP_WIDTH pixels: payload blue, overhead,
+ *     rounding and unsplit leftovers orange, free blocks grey.
+ */
+int heapstat_map(const char *path, char **blocks, size_t *sizes, int n)
+{
+	walk_t w;
+	FILE *fp;
+	size_t npix = (mem_heapsize() + MAP_UNIT - 1) / MAP_UNIT;
+	size_t rows = (npix + MAP_WIDTH - 1) / MAP_WIDTH;
+
+	if (rows == 0)
+		rows = 1;
+	if (init_walk(&w, blocks, sizes, n) < 0 ||
+		(w.image = calloc(rows * MAP_WIDTH, 3)) == NULL)
+	{
+		fprintf(stderr, "heapstat_map: out of memory\n");
+		free(w.live);
+		return -1;
+	}
+	mm_engine->heap_walk(map_block, &w);
+
+	if ((fp = fopen(path, "wb")) == NULL)
+	{
+		perror(path);
+		free(w.live);
+		free(w.image);
+		return -1;
+	}
+	fprintf(fp, "P6\n%d %lu\n255\n", MAP_WIDTH, (unsigned long)rows);
+	fwrite(w.image, 3, rows * MAP_WIDTH, fp);
+	free(w.live);
+	free(w.image);
+	if (fclose(fp) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef __HEAPSTAT_H_
+#define __HEAPSTAT_H_
+
+#include <stdio.h>
+
+/*
+ * heapstat.h - heap layout analysis on top of mm_heap_walk
+ */
+
+/* Free blocks are counted in power-of-two size classes starting at 32 */
+#define HS_MINCLASS 5
+#define HS_NCLASSES 27
+
+/* The layout of the heap at one point of a trace */
+typedef struct
+{
+	size_t heap;					 /* heap size in bytes */
+	size_t nalloc, nfree;			 /* allocated and free blocks */
+	size_t payload;					 /* requested bytes of allocated blocks */
+	size_t overhead;				 /* header and footer bytes */
+	size_t rounding;				 /* alignment and minimum block rounding */
+	size_t unsplit;					 /* leftovers too small to split off */
+	size_t free_bytes;				 /* bytes in free blocks */
+	size_t largest;					 /* largest free block */
+	size_t class_count[HS_NCLASSES]; /* free blocks per size class ... */
+	size_t class_bytes[HS_NCLASSES]; /* ... and their bytes */
+} heapstat_t;
+
+/*
+ * The allocated blocks are described by the driver's per-id arrays:
+ * blocks[i] is the payload pointer of id i (NULL if not allocated) and
+ * sizes[i] its requested size.
+ */
+int heapstat_collect(heapstat_t *hs, char **blocks, size_t *sizes, int n);
+void heapstat_print(FILE *fp, heapstat_t *hs);
+int heapstat_map(const char *path, char **blocks, size_t *sizes, int n);
+
+#endif /* __HEAPSTAT_H_ */
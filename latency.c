@@ -0,0 +1,156 @@
+/*
+ * latency.c - Histograms of the time single allocator calls take
+ *     (mdriver -L). Throughput hides the calls that take much longer
+ *     than the rest: a page fault, a long free-list walk, a coalesce
+ *     that finds every neighbor free. The histogram keeps them.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "latency.h"
+
+#define SUB_BITS 3 /* log2(LAT_SUB) */
+#define BAR_MAX 40 /* widest bar of lat_print */
+
+/*
+ * lat_bucket - The bucket of a sample of v ns
+ */
+static int lat_bucket(unsigned long v)
+{
+	int e, i;
+
+	if (v < LAT_SUB)
+		return (int)v;
+	e = 63 - __builtin_clzl(v); /* 2^e <= v < 2^(e+1) */
+	i = LAT_SUB + (e - SUB_BITS) * LAT_SUB + (int)((v >> (e - SUB_BITS)) - LAT_SUB);
+	return i < LAT_NBUCKETS ? i : LAT_NBUCKETS - 1;
+}
+
+/*
+ * lat_edge - The lower edge of bucket i, in ns
+ */
+static double lat_edge(int i)
+{
+	int e, sub;
+
+	if (i < LAT_SUB)
+		return i;
+	e = (i - LAT_SUB) / LAT_SUB + SUB_BITS;
+	sub = (i - LAT_SUB) % LAT_SUB;
+	return ldexp(LAT_SUB + sub, e - SUB_BITS);
+}
+
+void lat_add(lat_hist_t *h, double ns)
+{
+	if (ns < 0)
+		ns = 0;
+	h->count[lat_bucket((unsigned long)ns)]++;
+	h->n++;
+	h->sum += ns;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+void lat_merge(lat_hist_t *dst, const lat_hist_t *src)
+{
+	int i;
+
+	for (i = 0; i < LAT_NBUCKETS; i++)
+		dst->count[i] += src->count[i];
+	dst->n += src->n;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->faults += src->faults;
+	dst->faulted += src->faulted;
+}
+
+double lat_quantile(const lat_hist_t *h, double q)
+{
+	double want = q * h->n, seen = 0, edge;
+	int i;
+
+	if (h->n == 0)
+		return 0;
+	for (i = 0; i < LAT_NBUCKETS - 1; i++)
+	{
+		seen += h->count[i];
+		if (seen >= want)
+			break;
+	}
+	edge = lat_edge(i + 1);
+	return edge < h->max ? edge : h->max;
+}
+
+double lat_overhead(void)
+{
+	struct timespec t0, t1;
+	double ns, best = -1;
+	int i;
+
+	for (i = 0; i < 1000; i++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		if (best < 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+/*
+ * fmt_ns - Format a time in ns with a unit that keeps it short
+ */
+static void fmt_ns(char *buf, size_t len, double ns)
+{
+	if (ns < 1e3)
+		snprintf(buf, len, "%.0f ns", ns);
+	else if (ns < 1e6)
+		snprintf(buf, len, "%.0f us", ns / 1e3);
+	else if (ns < 1e9)
+		snprintf(buf, len, "%.0f ms", ns / 1e6);
+	else
+		snprintf(buf, len, "%.0f s", ns / 1e9);
+}
+
+/*
+ * lat_print - One row per power of two, from the first to the last that
+ *     has samples, with the share of the calls, the share at or below
+ *     it, and a bar on a log scale so that the rare slow calls show
+ */
+void lat_print(FILE *fp, const lat_hist_t *h)
+{
+	unsigned long row[64], done = 0;
+	double edge;
+	char label[32];
+	int i, k, lo = 64, hi = -1, bar;
+
+	memset(row, 0, sizeof(row));
+	for (i = 0; i < LAT_NBUCKETS; i++)
+	{
+		if (h->count[i] == 0)
+			continue;
+		edge = lat_edge(i);
+		k = edge < 1 ? 0 : 63 - __builtin_clzl((unsigned long)edge);
+		row[k] += h->count[i];
+		if (k < lo)
+			lo = k;
+		if (k > hi)
+			hi = k;
+	}
+	fprintf(fp, "%10s%12s%9s%9s\n", "below", "calls", "%", "cum %");
+	for (k = lo; k <= hi; k++)
+	{
+		done += row[k];
+		fmt_ns(label, sizeof(label), ldexp(1, k + 1));
+		fprintf(fp, "%10s%12lu%8.3f%%%8.3f%%  ", label, row[k],
+				100.0 * row[k] / h->n, 100.0 * done / h->n);
+		bar = row[k] ? (int)(log10((double)row[k]) * 6) + 1 : 0;
+		for (i = 0; i < bar && i < BAR_MAX; i++)
+			putc('#', fp);
+		putc('\n', fp);
+	}
+}
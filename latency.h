@@ -0,0 +1,44 @@
+#ifndef __LATENCY_H_
+#define __LATENCY_H_
+
+#include <stdio.h>
+
+/*
+ * latency.h - histograms of the time single allocator calls take
+ */
+
+/*
+ * Log-linear buckets: values below LAT_SUB nanoseconds have a bucket
+ * each, and every power of two above that is split into LAT_SUB
+ * buckets, so a bucket is at most 1/LAT_SUB of its value wide. The
+ * buckets reach 2^39 ns (about 9 minutes); longer samples go in the
+ * last one.
+ */
+#define LAT_SUB 8
+#define LAT_NBUCKETS (LAT_SUB + 36 * LAT_SUB)
+
+typedef struct
+{
+	unsigned long count[LAT_NBUCKETS];
+	unsigned long n; /* samples */
+	double sum;		 /* their total, in ns */
+	double max;		 /* the largest */
+	unsigned long faults;  /* page faults taken inside the calls */
+	unsigned long faulted; /* calls that took one or more */
+} lat_hist_t;
+
+void lat_add(lat_hist_t *h, double ns);
+void lat_merge(lat_hist_t *dst, const lat_hist_t *src);
+
+/* The upper edge of the bucket that holds quantile q (0 < q <= 1), or
+   the largest sample if that is smaller; 0 for an empty histogram */
+double lat_quantile(const lat_hist_t *h, double q);
+
+/* The time of an empty pair of clock_gettime calls, which the driver
+   takes off each sample */
+double lat_overhead(void);
+
+/* Print the histogram with one row per power of two */
+void lat_print(FILE *fp, const lat_hist_t *h);
+
+#endif /* __LATENCY_H_ */
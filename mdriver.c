@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* RUSAGE_THREAD */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,6 +16,15 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+#include <fcntl.h>
 
 extern char *optarg; // Added declaration for optarg
 
@@ -22,6 +32,10 @@ extern char *optarg; // Added declaration for optarg
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "results.h"
+#include "heapstat.h"
+#include "engine.h"
+#include "trace.h"
 
 /**********************
  * Constants and macros
@@ -31,6 +45,16 @@ extern char *optarg; // Added declaration for optarg
 #define MAXLINE 1024	   /* max string size */
 #define HDRLINES 4		   /* number of header lines in a trace file */
 #define LINENUM(i) (i + 5) /* cnvt trace request nums to linenums (origin 1) */
+#define PROFILE_HEADER \
+	"trace,op,live,heap,free_blocks,free_bytes,largest_free,util,frag\n"
+
+/* Sampled payload checks (-q): blocks above SAMPLE_MIN bytes only have
+   their head and tail SAMPLE_EDGE bytes and SAMPLE_STRIPES random
+   stripes of SAMPLE_STRIPE bytes checked */
+#define SAMPLE_MIN 4096
+#define SAMPLE_EDGE 512
+#define SAMPLE_STRIPES 16
+#define SAMPLE_STRIPE 64
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p) ((((unsigned int)(p)) % ALIGNMENT) == 0)
@@ -39,38 +63,27 @@ extern char *optarg; // Added declaration for optarg
  * The key compound data types
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a map of the heap in
+   granules of ALIGNMENT bytes: payloads start on a granule, so two of
+   them overlap exactly when they share one */
 typedef struct range_t
 {
-	char *lo;			  /* low payload address */
-	char *hi;			  /* high payload address */
-	struct range_t *next; /* next list element */
+	unsigned char *map; /* RANGE_START, RANGE_MORE or 0 per granule */
+	size_t len;			/* granules in map, from mem_heap_lo() */
 } range_t;
+#define RANGE_START 1 /* first granule of a payload */
+#define RANGE_MORE 2  /* any other granule of it */
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct
-{
-	enum
-	{
-		ALLOC,
-		FREE,
-		REALLOC
-	} type;	   /* type of request */
-	int index; /* index for free() to use later */
-	int size;  /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+/* Accumulates the heap profile of one trace (-p/-P) */
 typedef struct
 {
-	int sugg_heapsize;	 /* suggested heap size (unused) */
-	int num_ids;		 /* number of alloc/realloc ids */
-	int num_ops;		 /* number of distinct requests */
-	int weight;			 /* weight for this trace (unused) */
-	traceop_t *ops;		 /* array of requests */
-	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
-	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+	int samples;	  /* number of samples taken */
+	double util_sum;  /* sum of the sampled utilizations */
+	double peak_frag; /* largest sampled external fragmentation */
+	FILE *fp;		  /* memory stream collecting the CSV rows ... */
+	char *buf;		  /* ... and its buffer */
+	size_t len;
+} profile_t;
 
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
@@ -81,21 +94,33 @@ typedef struct
 {
 	trace_t *trace;
 	range_t *ranges;
+	mm_engine_t *engine; /* the allocator to time */
 } speed_t;
 
-/* Summarizes the important stats for some malloc function on some trace */
+/* A configuration of the allocator's parameters tried by -T */
 typedef struct
 {
-	/* defined for both libc malloc and student malloc package (mm.c) */
-	double ops;	 /* number of ops (malloc/free/realloc) in the trace */
-	int valid;	 /* was the trace processed correctly by the allocator? */
-	double secs; /* number of secs needed to run the trace */
+	mm_params_t params;
+	double score; /* goal on the traces of its last round, -1 if invalid */
+	double util;  /* average utilization on those traces */
+	double kops;  /* throughput on those traces */
+} tune_cand_t;
 
-	/* defined only for the student malloc package */
-	double util; /* space utilization for this trace (always 0 for libc) */
-
-	/* Note: secs and util are only defined if valid is true */
-} stats_t;
+/*
+ * The parameter grid searched by -T: every combination of these values
+ * is a candidate. Successive halving keeps the best 1/TUNE_ETA of the
+ * candidates after each round and gives the next round TUNE_ETA times
+ * as many traces. The grid has 5 * 4 * 3 * 2 * 4 = 480 candidates, so
+ * with the 11 default traces a search measures about 1650 trace runs
+ * (-G: 5280); -n and -w set what each of those costs.
+ */
+static const size_t tune_chunksize[] = {1 << 12, 1 << 13, 1 << 14, 1 << 15, 1 << 16};
+static const size_t tune_min_split[] = {32, 48, 64, 128};
+static const size_t tune_min_block[] = {32, 48, 64};
+static const size_t tune_round[] = {16, 32};
+static const size_t tune_tail_min[] = {0, 64, 128, 256};
+#define TUNE_ETA 3
+#define NELEMS(a) (sizeof(a) / sizeof((a)[0]))
 
 /********************
  * Global variables
@@ -111,6 +136,39 @@ static char tracedir[MAXLINE] = TRACEDIR;
 static char *default_tracefiles[] = {
 	DEFAULT_TRACEFILES, NULL};
 
+/* Token pipe that serializes the timed runs of parallel workers (-S) */
+static int timing_token[2] = {-1, -1};
+
+/* Heap profile: sample the heap every profile_interval ops (-p) and
+   append the samples to profile_fd (-P) */
+static int profile_interval = 0;
+static int profile_fd = -1;
+
+/* Check only samples of big realloc'd payloads (-q) */
+static int sampled_check = 0;
+
+/* Analyze the heap at the peak of each trace (-H) and draw it to
+   <heap_map><tracenum>.ppm (-M) */
+static int heap_report = 0;
+static char *heap_map = NULL;
+
+/* Blocks, and the largest size, that eval_mm_memalign asks for */
+#define MEMALIGN_CHECKS 512
+#define MEMALIGN_MAX_SIZE 5000
+
+/* Time every allocator call of LAT_OPS or more ops per trace (-L) */
+static int latency_report = 0;
+#define LAT_OPS 100000
+
+/* Replay LOC_OPS or more ops per trace writing every new block and
+   reading LOC_SAMPLE live blocks every LOC_PERIOD ops (-A); count the
+   pages that hold live blocks LOC_SNAPS times per run */
+static int locality_report = 0;
+#define LOC_OPS 100000
+#define LOC_PERIOD 16
+#define LOC_SAMPLE 8
+#define LOC_SNAPS 16
+
 /*********************
  * Function prototypes
  *********************/
@@ -121,22 +179,60 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+						  range_t **ranges);
+static void eval_mm_parallel(char **tracefiles, int n, stats_t *stats,
+							 int nworkers, int cpu, int serialize);
+static int eval_mm_check(trace_t *trace, int tracenum, range_t **ranges,
+						 stats_t *stats);
+static int check_payload(char *p, int c, int size);
+static void eval_mm_memalign(mm_engine_t *e);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, mm_engine_t *e, stats_t *stats);
+static long thread_faults(void);
+static void eval_mm_locality(trace_t *trace, mm_engine_t *e, stats_t *stats);
+static long live_pages(trace_t *trace, int *live, int nlive);
+static int pmu_open(unsigned int type, unsigned long config);
+static void pmu_enable(int *fd, int n, int on);
+static double pmu_read(int fd);
+static int start_heap(mm_engine_t *e, int cold);
+static void eval_engines(char **tracefiles, int n, mm_engine_t **engines,
+						 int nengines);
+
+/* These functions tune the allocator's parameters (-T) */
+static void tune(char **tracefiles, int n, char *outfile, double weight,
+				 int grid);
+static void tune_eval(tune_cand_t *cand, trace_t **traces, int n, int m,
+					  stats_t *stats, double weight);
+static int cmp_cand(const void *a, const void *b);
+
+/* These functions record the heap profile of one trace (-p/-P) */
+static void init_profile(profile_t *prof);
+static void sample_heap(profile_t *prof, int tracenum, int opnum, int live);
+static void finish_profile(profile_t *prof, stats_t *stats);
+
+/* These functions analyze the heap at the peak of a trace (-H/-M) */
+static int peak_op(trace_t *trace);
+static void analyze_heap(trace_t *trace, int tracenum, int opnum);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printprofile(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printlocality(int n, stats_t *stats);
+static void printloc(double ops, double secs, double misses, double tlb,
+					 double pages, double min_pages);
+static void printcompare(int n, mm_engine_t **engines, int nengines,
+						 stats_t *stats);
+static double perf_index(int n, stats_t *stats, double weight, double *p1,
+						 double *p2);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -160,15 +256,28 @@ int main(int argc, char **argv)
 	int team_check = 1; /* If set, check team structure (reset by -a) */
 	int run_libc = 0;	/* If set, run libc malloc (set by -l) */
 	int autograder = 0; /* If set, emit summary info for autograder (-g) */
+	char *outfile = NULL;  /* If set, write results to this file (-o) */
+	char *basefile = NULL; /* If set, compare against this file (-b) */
+	double threshold = 0.05; /* regression noise threshold (-r) */
+	int regressions = 0;
+	int nworkers = 1;	/* number of worker processes (-j) */
+	int cpu = -1;		/* first CPU to pin to (-c) */
+	int serialize = 0;	/* If set, time one worker at a time (-S) */
+	mm_stats_t counters; /* only used to see if mm.c keeps counters */
+	mm_engine_t *engines[MAX_ENGINES]; /* allocators to test (-e) */
+	int nengines = 0;
+	char *tunefile = NULL;	/* If set, tune and write the header here (-T) */
+	int tune_grid = 0;		/* If set, tune by a full grid search (-G) */
+	double tune_weight = UTIL_WEIGHT; /* weight of util in the goal (-W) */
 
 	/* temporaries used to compute the performance index */
-	double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+	double p1, p2, perfindex;
 	int numcorrect;
 
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF)
+	while ((c = getopt(argc, argv, "f:t:hvVgalc:w:n:k:mo:b:r:j:Sp:P:qHLAM:e:T:GW:")) != EOF)
 	{
 		printf("getopt returned: %d\n", c); // 디버깅용 출력 추가
 
@@ -181,7 +290,7 @@ int main(int argc, char **argv)
 			num_tracefiles = 1;
 			if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
 				unix_error("ERROR: realloc failed in main");
-			strcpy(tracedir, "./");
+			strcpy(tracedir, (optarg[0] == '/') ? "" : "./");
 			tracefiles[0] = strdup(optarg);
 			tracefiles[1] = NULL;
 			break;
@@ -198,6 +307,81 @@ int main(int argc, char **argv)
 		case 'l': /* Run libc malloc */
 			run_libc = 1;
 			break;
+		case 'e': /* Test this allocator engine (repeatable) */
+			if (nengines == MAX_ENGINES)
+				app_error("Too many engines (-e)");
+			if ((engines[nengines++] = engine_get(optarg)) == NULL)
+				exit(1);
+			break;
+		case 'T': /* Tune the parameters and write the best as a header */
+			tunefile = optarg;
+			break;
+		case 'G': /* Tune by a full grid search */
+			tune_grid = 1;
+			break;
+		case 'W': /* Weight of utilization in the tuning goal, in percent */
+			tune_weight = atof(optarg) / 100.0;
+			if (tune_weight < 0 || tune_weight > 1)
+				app_error("-W takes a percentage from 0 to 100");
+			break;
+		case 'c': /* Pin the driver to one CPU while timing */
+			cpu = atoi(optarg);
+			set_fsecs_cpu(cpu);
+			break;
+		case 'w': /* Untimed warmup runs per measurement */
+			set_fsecs_warmup(atoi(optarg));
+			break;
+		case 'n': /* Timed runs per measurement */
+			set_fsecs_reps(atoi(optarg));
+			break;
+		case 'k': /* Report the mean of the k fastest runs */
+			set_fsecs_kbest(atoi(optarg));
+			break;
+		case 'm': /* Report the median run */
+			set_fsecs_kbest(0);
+			break;
+		case 'o': /* Write machine-readable results */
+			outfile = optarg;
+			break;
+		case 'b': /* Compare against the results of an earlier run */
+			basefile = optarg;
+			break;
+		case 'r': /* Regression threshold in percent */
+			threshold = atof(optarg) / 100.0;
+			break;
+		case 'j': /* Evaluate the traces in this many worker processes */
+			nworkers = atoi(optarg);
+			if (nworkers < 1)
+				nworkers = 1;
+			break;
+		case 'S': /* Serialize the timed runs of the workers */
+			serialize = 1;
+			break;
+		case 'p': /* Sample the heap every n ops */
+			profile_interval = atoi(optarg);
+			break;
+		case 'P': /* Write the heap samples to a CSV file */
+			if ((profile_fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+								   0644)) < 0)
+				unix_error("Could not open heap profile file");
+			if (write(profile_fd, PROFILE_HEADER, strlen(PROFILE_HEADER)) < 0)
+				unix_error("write failed in main");
+			break;
+		case 'q': /* Sampled payload checks for big blocks */
+			sampled_check = 1;
+			break;
+		case 'H': /* Analyze the heap at the peak of each trace */
+			heap_report = 1;
+			break;
+		case 'L': /* Histogram of the time of each allocator call */
+			latency_report = 1;
+			break;
+		case 'A': /* Replay touching the payloads, as an application would */
+			locality_report = 1;
+			break;
+		case 'M': /* Draw the heap at the peak of each trace */
+			heap_map = optarg;
+			break;
 		case 'v': /* Print per-trace performance breakdown */
 			verbose = 1;
 			break;
@@ -213,6 +397,19 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (profile_fd >= 0 && profile_interval <= 0)
+		profile_interval = 100;
+
+	/* Without -e, test the mm.c linked into the driver */
+	if (nengines == 0)
+		engines[nengines++] = engine_get("mm");
+	mm_engine = engines[0];
+	if (nengines > 1 && (nworkers > 1 || outfile || basefile || tunefile))
+	{
+		printf("ERROR: -j, -o, -b and -T take a single engine\n");
+		exit(1);
+	}
+
 	/*
 	 * Check and print team info
 	 */
@@ -284,7 +481,8 @@ int main(int argc, char **argv)
 				speed_params.trace = trace;
 				if (verbose > 1)
 					printf("and performance.\n");
-				libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+				libc_stats[i].secs = fsecs_ci(eval_libc_speed, &speed_params,
+											  &libc_stats[i].ci);
 			}
 			free_trace(trace);
 		}
@@ -297,86 +495,86 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/*
+	 * With -T, search for the best parameters instead of scoring
+	 */
+	if (tunefile)
+	{
+		tune(tracefiles, num_tracefiles, tunefile, tune_weight, tune_grid);
+		exit(0);
+	}
+
+	/*
+	 * With several engines, run them all on each trace and compare
+	 */
+	if (nengines > 1)
+	{
+		eval_engines(tracefiles, num_tracefiles, engines, nengines);
+		exit(errors ? 1 : 0);
+	}
+
 	/*
 	 * Always run and evaluate the student's mm package
 	 */
 	if (verbose > 1)
-		printf("\nTesting mm malloc\n");
+		printf("\nTesting %s malloc\n", mm_engine->name);
 
 	/* Allocate the mm stats array, with one stats_t struct per tracefile */
 	mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
 	if (mm_stats == NULL)
 		unix_error("mm_stats calloc in main failed");
 
-	/* Initialize the simulated memory system in memlib.c */
-	mem_init();
-
-	/* Evaluate student's mm malloc package using the K-best scheme */
-	for (i = 0; i < num_tracefiles; i++)
+	if (nworkers > 1)
 	{
-		trace = read_trace(tracedir, tracefiles[i]);
-		mm_stats[i].ops = trace->num_ops;
-		if (verbose > 1)
-			printf("Checking mm_malloc for correctness, ");
-		mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-		if (mm_stats[i].valid)
-		{
-			if (verbose > 1)
-				printf("efficiency, ");
-			mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-			speed_params.trace = trace;
-			speed_params.ranges = ranges;
-			if (verbose > 1)
-				printf("and performance.\n");
-			mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-		}
-		free_trace(trace);
+		/* Each worker process builds its own simulated heap */
+		eval_mm_parallel(tracefiles, num_tracefiles, mm_stats,
+						 nworkers, cpu, serialize);
+	}
+	else
+	{
+		/* Initialize the simulated memory system in memlib.c */
+		mem_init();
+
+		/* Evaluate student's mm malloc package using the K-best scheme */
+		for (i = 0; i < num_tracefiles; i++)
+			eval_mm_trace(tracefiles[i], i, &mm_stats[i], &ranges);
+		eval_mm_memalign(mm_engine);
 	}
 
 	/* Display the mm results in a compact table */
 	if (verbose)
 	{
-		printf("\nResults for mm malloc:\n");
+		printf("\nResults for %s malloc:\n", mm_engine->name);
 		printresults(num_tracefiles, mm_stats);
+		if (profile_interval > 0)
+			printprofile(num_tracefiles, mm_stats);
+		if (mm_engine->get_stats && mm_engine->get_stats(&counters))
+			printcounters(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (latency_report)
+	{
+		printf("\nCall latency of %s malloc:\n", mm_engine->name);
+		printlatency(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (locality_report)
+	{
+		printf("\nLocality of %s malloc:\n", mm_engine->name);
+		printlocality(num_tracefiles, mm_stats);
 		printf("\n");
 	}
 
 	/*
-	 * Accumulate the aggregate statistics for the student's mm package
+	 * Count the correct traces, and compute and print the performance index
 	 */
-	secs = 0;
-	ops = 0;
-	util = 0;
 	numcorrect = 0;
 	for (i = 0; i < num_tracefiles; i++)
-	{
-		secs += mm_stats[i].secs;
-		ops += mm_stats[i].ops;
-		util += mm_stats[i].util;
 		if (mm_stats[i].valid)
 			numcorrect++;
-	}
-	avg_mm_util = util / num_tracefiles;
-
-	/*
-	 * Compute and print the performance index
-	 */
 	if (errors == 0)
 	{
-		avg_mm_throughput = ops / secs;
-
-		p1 = UTIL_WEIGHT * avg_mm_util;
-		if (avg_mm_throughput > AVG_LIBC_THRUPUT)
-		{
-			p2 = (double)(1.0 - UTIL_WEIGHT);
-		}
-		else
-		{
-			p2 = ((double)(1.0 - UTIL_WEIGHT)) *
-				 (avg_mm_throughput / AVG_LIBC_THRUPUT);
-		}
-
-		perfindex = (p1 + p2) * 100.0;
+		perfindex = perf_index(num_tracefiles, mm_stats, UTIL_WEIGHT, &p1, &p2);
 		printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
 			   p1 * 100,
 			   p2 * 100,
@@ -394,26 +592,44 @@ int main(int argc, char **argv)
 		printf("perfidx:%.0f\n", perfindex);
 	}
 
+	/*
+	 * Optionally save the results and gate them against a baseline
+	 */
+	if (outfile && write_results(outfile, tracefiles, num_tracefiles,
+								 mm_stats, perfindex) < 0)
+		exit(1);
+	if (basefile)
+	{
+		regressions = compare_results(basefile, tracefiles, num_tracefiles,
+									  mm_stats, threshold);
+		if (regressions < 0)
+			exit(1);
+		if (regressions > 0)
+			exit(2);
+	}
+
 	exit(0);
 }
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range map, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range map to detect any overlapping allocated blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list.
+ *     we mark its granules in the range map.
  */
 static int add_range(range_t **ranges, char *lo, int size,
 					 int tracenum, int opnum)
 {
 	char *hi = lo + size - 1;
-	range_t *p;
+	char *base = mem_heap_lo();
+	size_t g, first, last, len;
+	range_t *r;
 	char msg[MAXLINE];
 
 	assert(size > 0);
@@ -437,389 +653,886 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must not overlap any other payloads */
-	for (p = *ranges; p != NULL; p = p->next)
+	/* Grow the map to the end of the heap */
+	if ((r = *ranges) == NULL)
+	{
+		if ((r = calloc(1, sizeof(range_t))) == NULL)
+			unix_error("calloc error in add_range");
+		*ranges = r;
+	}
+	first = (lo - base) / ALIGNMENT;
+	last = (hi - base) / ALIGNMENT;
+	if (last >= r->len)
 	{
-		if ((lo >= p->lo && lo <= p->hi) ||
-			(hi >= p->lo && hi <= p->hi))
+		len = mem_heapsize() / ALIGNMENT + 1;
+		if ((r->map = realloc(r->map, len)) == NULL)
+			unix_error("realloc error in add_range");
+		memset(r->map + r->len, 0, len - r->len);
+		r->len = len;
+	}
+
+	/* The payload must not overlap any other payloads; the other one's
+	   end is given to the granule */
+	for (g = first; g <= last; g++)
+		if (r->map[g])
 		{
+			for (first = g; r->map[first] != RANGE_START; first--)
+				;
+			for (last = g; last + 1 < r->len && r->map[last + 1] == RANGE_MORE; last++)
+				;
 			sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-					lo, hi, p->lo, p->hi);
+					lo, hi, base + first * ALIGNMENT, base + (last + 1) * ALIGNMENT - 1);
 			malloc_error(tracenum, opnum, msg);
 			return 0;
 		}
-	}
 
-	/*
-	 * Everything looks OK, so remember the extent of this block
-	 * by creating a range struct and adding it the range list.
-	 */
-	if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-		unix_error("malloc error in add_range");
-	p->next = *ranges;
-	p->lo = lo;
-	p->hi = hi;
-	*ranges = p;
+	/* Everything looks OK, so remember the extent of this block */
+	r->map[first] = RANGE_START;
+	memset(r->map + first + 1, RANGE_MORE, last - first);
 	return 1;
 }
 
 /*
- * remove_range - Free the range record of block whose payload starts at lo
+ * remove_range - Unmark the payload that starts at lo
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-	range_t *p;
-	range_t **prevpp = ranges;
-	int size;
-
-	for (p = *ranges; p != NULL; p = p->next)
-	{
-		if (p->lo == lo)
-		{
-			*prevpp = p->next;
-			size = p->hi - p->lo + 1;
-			free(p);
-			break;
-		}
-		prevpp = &(p->next);
-	}
+	range_t *r = *ranges;
+	size_t g = (lo - (char *)mem_heap_lo()) / ALIGNMENT;
+
+	if (r == NULL || g >= r->len || r->map[g] != RANGE_START)
+		return;
+	r->map[g++] = 0;
+	while (g < r->len && r->map[g] == RANGE_MORE)
+		r->map[g++] = 0;
 }
 
 /*
- * clear_ranges - free all of the range records for a trace
+ * clear_ranges - free the range map of a trace
  */
 static void clear_ranges(range_t **ranges)
 {
-	range_t *p;
-	range_t *pnext;
-
-	for (p = *ranges; p != NULL; p = pnext)
+	if (*ranges != NULL)
 	{
-		pnext = p->next;
-		free(p);
+		free((*ranges)->map);
+		free(*ranges);
 	}
 	*ranges = NULL;
 }
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * eval_mm_trace - Check, measure the utilization of, and time the mm
+ *     malloc package on one trace file
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+						  range_t **ranges)
 {
-	FILE *tracefile;
 	trace_t *trace;
-	char type[MAXLINE];
-	char path[MAXLINE];
-	unsigned index, size;
-	unsigned max_index = 0;
-	unsigned op_index;
+	speed_t speed_params;
+	char token;
 
+	trace = read_trace(tracedir, tracefile);
+	stats->ops = trace->num_ops;
 	if (verbose > 1)
-		printf("Reading tracefile: %s\n", filename);
-
-	/* Allocate the trace record */
-	if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
-		unix_error("malloc 1 failed in read_trance");
+		printf("Checking mm_malloc for correctness and efficiency, ");
+	stats->valid = eval_mm_check(trace, tracenum, ranges, stats);
+	if (stats->valid)
+	{
+		speed_params.trace = trace;
+		speed_params.ranges = *ranges;
+		speed_params.engine = mm_engine;
+		if (verbose > 1)
+			printf("and performance.\n");
+
+		/* With -S, hold the token for the duration of the timed runs */
+		if (timing_token[0] >= 0)
+			while (read(timing_token[0], &token, 1) != 1)
+				if (errno != EINTR)
+					unix_error("read of timing token failed");
+		stats->secs = fsecs_ci(eval_mm_speed, &speed_params, &stats->ci);
+		if (timing_token[1] >= 0)
+			if (write(timing_token[1], &token, 1) != 1)
+				unix_error("write of timing token failed");
+		if (latency_report)
+			eval_mm_latency(trace, mm_engine, stats);
+		if (locality_report)
+			eval_mm_locality(trace, mm_engine, stats);
+	}
+	free_trace(trace);
+}
 
-	/* Read the trace file header */
-	strcpy(path, tracedir);
-	strcat(path, filename);
-	if ((tracefile = fopen(path, "r")) == NULL)
+/*
+ * eval_mm_parallel - Spread the traces over nworkers forked processes,
+ *     each with its own memlib heap and pinned to its own CPU (starting
+ *     at cpu, or at CPU 0 if cpu < 0). Workers pull the next trace
+ *     number from a shared counter and write their stats_t, and the
+ *     number of errors they found, into shared memory. With serialize
+ *     set, the workers still check traces in parallel but take turns
+ *     for the timed runs, so the timings see an otherwise idle machine.
+ */
+static void eval_mm_parallel(char **tracefiles, int n, stats_t *stats,
+							 int nworkers, int cpu, int serialize)
+{
+	struct shared_t
 	{
-		sprintf(msg, "Could not open %s in read_trace", path);
-		unix_error(msg);
+		int next;	 /* next trace number to hand out */
+		int errors;	 /* errors found by all workers */
+	} *shared;
+	stats_t *shstats;
+	range_t *ranges = NULL;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int w, i, status;
+	pid_t pid;
+
+	if (ncpus < 1)
+		ncpus = 1;
+	if (nworkers > ncpus)
+		printf("Warning: %d workers share %ld CPUs; timings will be noisy.\n",
+			   nworkers, ncpus);
+
+	shared = mmap(NULL, sizeof(*shared) + n * sizeof(stats_t),
+				  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+		unix_error("mmap failed in eval_mm_parallel");
+	shstats = (stats_t *)(shared + 1);
+	shared->next = 0;
+	shared->errors = 0;
+
+	if (serialize)
+	{
+		if (pipe(timing_token) < 0)
+			unix_error("pipe failed in eval_mm_parallel");
+		if (write(timing_token[1], "t", 1) != 1)
+			unix_error("write failed in eval_mm_parallel");
 	}
-	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-	fscanf(tracefile, "%d", &(trace->num_ids));
-	fscanf(tracefile, "%d", &(trace->num_ops));
-	fscanf(tracefile, "%d", &(trace->weight)); /* not used */
-
-	/* We'll store each request line in the trace in this array */
-	if ((trace->ops =
-			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-		unix_error("malloc 2 failed in read_trace");
-
-	/* We'll keep an array of pointers to the allocated blocks here... */
-	if ((trace->blocks =
-			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-		unix_error("malloc 3 failed in read_trace");
-
-	/* ... along with the corresponding byte sizes of each block */
-	if ((trace->block_sizes =
-			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-		unix_error("malloc 4 failed in read_trace");
-
-	/* read every request line in the trace file */
-	index = 0;
-	op_index = 0;
-	while (fscanf(tracefile, "%s", type) != EOF)
+
+	/* Don't let the workers inherit (and repeat) unflushed output */
+	fflush(stdout);
+
+	for (w = 0; w < nworkers; w++)
 	{
-		switch (type[0])
+		if ((pid = fork()) < 0)
+			unix_error("fork failed in eval_mm_parallel");
+		if (pid == 0)
 		{
-		case 'a':
-			fscanf(tracefile, "%u %u", &index, &size);
-			trace->ops[op_index].type = ALLOC;
-			trace->ops[op_index].index = index;
-			trace->ops[op_index].size = size;
-			max_index = (index > max_index) ? index : max_index;
-			break;
-		case 'r':
-			fscanf(tracefile, "%u %u", &index, &size);
-			trace->ops[op_index].type = REALLOC;
-			trace->ops[op_index].index = index;
-			trace->ops[op_index].size = size;
-			max_index = (index > max_index) ? index : max_index;
-			break;
-		case 'f':
-			fscanf(tracefile, "%ud", &index);
-			trace->ops[op_index].type = FREE;
-			trace->ops[op_index].index = index;
-			break;
-		default:
-			printf("Bogus type character (%c) in tracefile %s\n",
-				   type[0], path);
-			exit(1);
+			fsecs_pin((int)(((cpu < 0 ? 0 : cpu) + w) % ncpus));
+			mem_init();
+			while ((i = __sync_fetch_and_add(&shared->next, 1)) < n)
+				eval_mm_trace(tracefiles[i], i, &shstats[i], &ranges);
+			__sync_fetch_and_add(&shared->errors, errors);
+			fflush(stdout);
+			_exit(0);
 		}
-		op_index++;
 	}
-	fclose(tracefile);
-	assert(max_index == trace->num_ids - 1);
-	assert(trace->num_ops == op_index);
 
-	return trace;
+	/* A worker that dies leaves its traces marked invalid */
+	while ((pid = wait(&status)) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			printf("ERROR: worker %d exited abnormally\n", (int)pid);
+			errors++;
+		}
+
+	memcpy(stats, shstats, n * sizeof(stats_t));
+	errors += shared->errors;
+	munmap(shared, sizeof(*shared) + n * sizeof(stats_t));
+	if (serialize)
+	{
+		close(timing_token[0]);
+		close(timing_token[1]);
+		timing_token[0] = timing_token[1] = -1;
+	}
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * eval_engines - Run several allocator engines on each trace, loaded
+ *     once: check each engine and measure its utilization, then time
+ *     the engines that passed with their timed runs interleaved, so
+ *     that they all see the same machine. Prints each engine's results
+ *     with -v and always a comparison table.
  */
-void free_trace(trace_t *trace)
+static void eval_engines(char **tracefiles, int n, mm_engine_t **engines,
+						 int nengines)
 {
-	free(trace->ops); /* free the three arrays... */
-	free(trace->blocks);
-	free(trace->block_sizes);
-	free(trace); /* and the trace record itself... */
-}
+	stats_t *stats, *st;
+	trace_t *trace;
+	range_t *ranges = NULL;
+	speed_t params[MAX_ENGINES];
+	void *argps[MAX_ENGINES];
+	double secs[MAX_ENGINES], ci[MAX_ENGINES];
+	int timed[MAX_ENGINES];
+	mm_stats_t counters;
+	int i, e, k, ntimed;
+
+	if ((stats = calloc(n * nengines, sizeof(stats_t))) == NULL)
+		unix_error("calloc failed in eval_engines");
+	mem_init();
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
+	for (i = 0; i < n; i++)
+	{
+		trace = read_trace(tracedir, tracefiles[i]);
+		ntimed = 0;
+		for (e = 0; e < nengines; e++)
+		{
+			mm_engine = engines[e];
+			st = &stats[e * n + i];
+			st->ops = trace->num_ops;
+			if (verbose > 1)
+				printf("Checking %s on %s\n", mm_engine->name, tracefiles[i]);
+			if ((st->valid = eval_mm_check(trace, i, &ranges, st)))
+			{
+				params[ntimed].trace = trace;
+				params[ntimed].ranges = ranges;
+				params[ntimed].engine = engines[e];
+				argps[ntimed] = &params[ntimed];
+				timed[ntimed++] = e;
+			}
+		}
+		if (ntimed > 0)
+			fsecs_interleaved(eval_mm_speed, argps, ntimed, secs, ci);
+		for (k = 0; k < ntimed; k++)
+		{
+			stats[timed[k] * n + i].secs = secs[k];
+			stats[timed[k] * n + i].ci = ci[k];
+			if (latency_report)
+				eval_mm_latency(trace, engines[timed[k]], &stats[timed[k] * n + i]);
+			if (locality_report)
+				eval_mm_locality(trace, engines[timed[k]], &stats[timed[k] * n + i]);
+		}
+		free_trace(trace);
+	}
+	for (e = 0; e < nengines; e++)
+		eval_mm_memalign(engines[e]);
+
+	if (verbose)
+		for (e = 0; e < nengines; e++)
+		{
+			mm_engine = engines[e];
+			printf("\nResults for %s malloc:\n", mm_engine->name);
+			printresults(n, &stats[e * n]);
+			if (profile_interval > 0)
+				printprofile(n, &stats[e * n]);
+			if (mm_engine->get_stats && mm_engine->get_stats(&counters))
+				printcounters(n, &stats[e * n]);
+		}
+	printcompare(n, engines, nengines, stats);
+	if (latency_report)
+		for (e = 0; e < nengines; e++)
+		{
+			printf("\nCall latency of %s malloc:\n", engines[e]->name);
+			printlatency(n, &stats[e * n]);
+		}
+	if (locality_report)
+		for (e = 0; e < nengines; e++)
+		{
+			printf("\nLocality of %s malloc:\n", engines[e]->name);
+			printlocality(n, &stats[e * n]);
+		}
+	clear_ranges(&ranges);
+	free(stats);
+}
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * tune - Search the parameter grid for the configuration of the engine
+ *     under test that scores best on the traces, weighing utilization
+ *     by weight and throughput by 1 - weight, and write it to outfile
+ *     as a header of MM_* defines. Uses successive halving: every
+ *     candidate runs on a few traces, the best 1/TUNE_ETA move on to
+ *     TUNE_ETA times as many, until the last round runs all traces.
+ *     With grid set, every candidate runs on all traces instead.
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
+static void tune(char **tracefiles, int n, char *outfile, double weight,
+				 int grid)
 {
-	int i, j;
-	int index;
-	int size;
-	int oldsize;
-	char *newp;
-	char *oldp;
-	char *p;
-
-	/* Reset the heap and free any records in the range list */
-	mem_reset_brk();
-	clear_ranges(ranges);
-
-	/* Call the mm package's init function */
-	if (mm_init() < 0)
+	trace_t **traces;
+	stats_t *stats;
+	tune_cand_t *cands, base;
+	int ncand, m, i, a, b, c, d, e, round;
+	FILE *fp;
+
+	/* An engine without parameters reports them all as 0 */
+	if (mm_engine->get_params)
+		mm_engine->get_params(&base.params);
+	if (!mm_engine->set_params || !mm_engine->get_params ||
+		base.params.chunksize == 0)
 	{
-		malloc_error(tracenum, 0, "mm_init failed.");
-		return 0;
+		printf("ERROR: engine %s has no parameters to tune\n", mm_engine->name);
+		exit(1);
 	}
 
-	/* Interpret each operation in the trace in order */
-	for (i = 0; i < trace->num_ops; i++)
-	{
-		index = trace->ops[i].index;
-		size = trace->ops[i].size;
+	ncand = NELEMS(tune_chunksize) * NELEMS(tune_min_split) *
+			NELEMS(tune_min_block) * NELEMS(tune_round) * NELEMS(tune_tail_min);
+	traces = malloc(n * sizeof(trace_t *));
+	stats = malloc(n * sizeof(stats_t));
+	cands = malloc(ncand * sizeof(tune_cand_t));
+	if (traces == NULL || stats == NULL || cands == NULL)
+		unix_error("malloc failed in tune");
+	i = 0;
+	for (a = 0; a < NELEMS(tune_chunksize); a++)
+		for (b = 0; b < NELEMS(tune_min_split); b++)
+			for (c = 0; c < NELEMS(tune_min_block); c++)
+				for (d = 0; d < NELEMS(tune_round); d++)
+					for (e = 0; e < NELEMS(tune_tail_min); e++)
+					{
+						cands[i].params = base.params;
+						cands[i].params.chunksize = tune_chunksize[a];
+						cands[i].params.min_split = tune_min_split[b];
+						cands[i].params.min_block = tune_min_block[c];
+						cands[i].params.round = tune_round[d];
+						cands[i++].params.tail_min = tune_tail_min[e];
+					}
 
-		switch (trace->ops[i].type)
+	mem_init();
+	for (i = 0; i < n; i++)
+		traces[i] = read_trace(tracedir, tracefiles[i]);
+
+	m = grid ? n : 1;
+	for (round = 1;; round++)
+	{
+		printf("Tuning round %d: %d configurations on %d of %d traces\n",
+			   round, ncand, m, n);
+		for (i = 0; i < ncand; i++)
 		{
+			tune_eval(&cands[i], traces, n, m, stats, weight);
+			if (verbose)
+				printf("  chunk %6zu  split %3zu  block %3zu  round %2zu  tail %3zu  goal %5.1f\n",
+					   cands[i].params.chunksize, cands[i].params.min_split,
+					   cands[i].params.min_block, cands[i].params.round,
+					   cands[i].params.tail_min, cands[i].score);
+		}
+		qsort(cands, ncand, sizeof(tune_cand_t), cmp_cand);
+		if (m == n)
+			break;
+		ncand = (ncand + TUNE_ETA - 1) / TUNE_ETA;
+		m = (m * TUNE_ETA < n) ? m * TUNE_ETA : n;
+	}
+	if (cands[0].score < 0)
+		app_error("no configuration passed the traces");
+
+	/* Score the defaults on all traces too, for comparison */
+	tune_eval(&base, traces, n, n, stats, weight);
+	mm_engine->set_params(&base.params);
+
+	printf("Default: chunk %zu, split %zu, block %zu, round %zu, tail %zu: "
+		   "goal %.1f (util %.1f%%, %.0f Kops)\n",
+		   base.params.chunksize, base.params.min_split, base.params.min_block,
+		   base.params.round, base.params.tail_min, base.score,
+		   base.util * 100.0, base.kops);
+	printf("Best:    chunk %zu, split %zu, block %zu, round %zu, tail %zu: "
+		   "goal %.1f (util %.1f%%, %.0f Kops)\n",
+		   cands[0].params.chunksize, cands[0].params.min_split,
+		   cands[0].params.min_block, cands[0].params.round,
+		   cands[0].params.tail_min, cands[0].score, cands[0].util * 100.0,
+		   cands[0].kops);
+
+	if ((fp = fopen(outfile, "w")) == NULL)
+		unix_error("Could not open the -T header");
+	fprintf(fp, "/*\n * %s - %s parameters tuned by mdriver -T on %d traces\n",
+			strrchr(outfile, '/') ? strrchr(outfile, '/') + 1 : outfile,
+			mm_engine->name, n);
+	fprintf(fp, " *     goal %.1f (%.0f%% util + %.0f%% throughput): util %.1f%%, %.0f Kops\n",
+			cands[0].score, weight * 100, (1 - weight) * 100,
+			cands[0].util * 100.0, cands[0].kops);
+	fprintf(fp, " *     the defaults scored %.1f\n */\n", base.score);
+	fprintf(fp, "#define MM_CHUNKSIZE %zu\n", cands[0].params.chunksize);
+	fprintf(fp, "#define MM_MIN_SPLIT %zu\n", cands[0].params.min_split);
+	fprintf(fp, "#define MM_MIN_BLOCK %zu\n", cands[0].params.min_block);
+	fprintf(fp, "#define MM_ROUND %zu\n", cands[0].params.round);
+	fprintf(fp, "#define MM_TAIL_MIN %zu\n", cands[0].params.tail_min);
+	if (fclose(fp) != 0)
+		unix_error("Could not write the -T header");
+	printf("Wrote %s\n", outfile);
 
-		case ALLOC: /* mm_malloc */
+	for (i = 0; i < n; i++)
+		free_trace(traces[i]);
+	free(traces);
+	free(stats);
+	free(cands);
+}
 
-			/* Call the student's malloc */
-			if ((p = mm_malloc(size)) == NULL)
-			{
-				malloc_error(tracenum, i, "mm_malloc failed.");
-				return 0;
-			}
+/*
+ * tune_eval - Score cand on m of the n traces, spread evenly over them:
+ *     check each, measure its utilization and time it
+ */
+static void tune_eval(tune_cand_t *cand, trace_t **traces, int n, int m,
+					  stats_t *stats, double weight)
+{
+	range_t *ranges = NULL;
+	speed_t params;
+	double p1, p2, ops = 0, secs = 0, util = 0;
+	int i, j;
 
-			/*
-			 * Test the range of the new block for correctness and add it
-			 * to the range list if OK. The block must be  be aligned properly,
-			 * and must not overlap any currently allocated block.
-			 */
-			if (add_range(ranges, p, size, tracenum, i) == 0)
-				return 0;
+	cand->score = -1;
+	if (mm_engine->set_params(&cand->params) < 0)
+		return;
+	for (j = 0; j < m; j++)
+	{
+		i = j * n / m;
+		memset(&stats[j], 0, sizeof(stats_t));
+		stats[j].ops = traces[i]->num_ops;
+		if (!(stats[j].valid = eval_mm_check(traces[i], i, &ranges, &stats[j])))
+		{
+			clear_ranges(&ranges);
+			return;
+		}
+		params.trace = traces[i];
+		params.ranges = ranges;
+		params.engine = mm_engine;
+		stats[j].secs = fsecs_ci(eval_mm_speed, &params, &stats[j].ci);
+		ops += stats[j].ops;
+		secs += stats[j].secs;
+		util += stats[j].util;
+	}
+	clear_ranges(&ranges);
+	cand->score = perf_index(m, stats, weight, &p1, &p2);
+	cand->util = util / m;
+	cand->kops = ops / secs / 1e3;
+}
 
-			/* ADDED: cgw
-			 * fill range with low byte of index.  This will be used later
-			 * if we realloc the block and wish to make sure that the old
-			 * data was copied to the new block
-			 */
-			memset(p, index & 0xFF, size);
+/* cmp_cand - qsort order of candidates, best score first */
+static int cmp_cand(const void *a, const void *b)
+{
+	double sa = ((const tune_cand_t *)a)->score;
+	double sb = ((const tune_cand_t *)b)->score;
 
-			/* Remember region */
-			trace->blocks[index] = p;
-			trace->block_sizes[index] = size;
-			break;
+	return (sa < sb) - (sa > sb);
+}
 
-		case REALLOC: /* mm_realloc */
+/*
+ * check_bytes - Are all size bytes at p equal to c? Compares a word at
+ *     a time, four words per step.
+ */
+typedef unsigned long __attribute__((__may_alias__)) word_t;
 
-			/* Call the student's realloc */
-			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, size)) == NULL)
-			{
-				malloc_error(tracenum, i, "mm_realloc failed.");
-				return 0;
-			}
+static int check_bytes(const unsigned char *p, int c, size_t size)
+{
+	word_t pat = (~0UL / 0xFF) * (unsigned char)c;
+	const word_t *w;
+	size_t i, nw;
 
-			/* Remove the old region from the range list */
-			remove_range(ranges, oldp);
+	for (; size > 0 && ((unsigned long)p % sizeof(word_t)) != 0; p++, size--)
+		if (*p != (unsigned char)c)
+			return 0;
 
-			/* Check new block for correctness and add it to range list */
-			if (add_range(ranges, newp, size, tracenum, i) == 0)
-				return 0;
+	w = (const word_t *)p;
+	nw = size / sizeof(word_t);
+	for (i = 0; i + 4 <= nw; i += 4)
+		if (((w[i] ^ pat) | (w[i + 1] ^ pat) | (w[i + 2] ^ pat) | (w[i + 3] ^ pat)) != 0)
+			return 0;
+	for (; i < nw; i++)
+		if (w[i] != pat)
+			return 0;
 
-			/* ADDED: cgw
-			 * Make sure that the new block contains the data from the old
-			 * block and then fill in the new block with the low order byte
-			 * of the new index
-			 */
-			oldsize = trace->block_sizes[index];
-			if (size < oldsize)
-				oldsize = size;
-			for (j = 0; j < oldsize; j++)
-			{
-				if (newp[j] != (index & 0xFF))
-				{
-					malloc_error(tracenum, i, "mm_realloc did not preserve the "
-											  "data from old block");
-					return 0;
-				}
-			}
-			memset(newp, index & 0xFF, size);
+	for (p += nw * sizeof(word_t), size -= nw * sizeof(word_t); size > 0; p++, size--)
+		if (*p != (unsigned char)c)
+			return 0;
+	return 1;
+}
 
-			/* Remember region */
-			trace->blocks[index] = newp;
-			trace->block_sizes[index] = size;
-			break;
+/*
+ * check_payload - Does the payload at p still hold byte c? With -q, a
+ *     big payload only has its head, tail and some random stripes checked.
+ */
+static int check_payload(char *p, int c, int size)
+{
+	static unsigned long seed = 1;
+	int k, off;
 
-		case FREE: /* mm_free */
+	if (!sampled_check || size <= SAMPLE_MIN)
+		return check_bytes((unsigned char *)p, c, size);
 
-			/* Remove region from list and call student's free function */
-			p = trace->blocks[index];
-			remove_range(ranges, p);
-			mm_free(p);
-			break;
+	if (!check_bytes((unsigned char *)p, c, SAMPLE_EDGE) ||
+		!check_bytes((unsigned char *)p + size - SAMPLE_EDGE, c, SAMPLE_EDGE))
+		return 0;
+	for (k = 0; k < SAMPLE_STRIPES; k++)
+	{
+		seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+		off = SAMPLE_EDGE + (seed >> 33) % (size - 2 * SAMPLE_EDGE - SAMPLE_STRIPE + 1);
+		if (!check_bytes((unsigned char *)p + off, c, SAMPLE_STRIPE))
+			return 0;
+	}
+	return 1;
+}
 
-		default:
-			app_error("Nonexistent request type in eval_mm_valid");
+/*
+ * peak_op - The first op after which the payloads of the trace add up
+ *     to their maximum. Uses trace->block_sizes as scratch.
+ */
+static int peak_op(trace_t *trace)
+{
+	int i, index;
+	int live = 0, max = -1, peak = 0;
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		index = trace->ops[i].index;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+			live += trace->ops[i].size;
+			trace->block_sizes[index] = trace->ops[i].size;
+			break;
+		case REALLOC:
+			live += trace->ops[i].size - trace->block_sizes[index];
+			trace->block_sizes[index] = trace->ops[i].size;
+			break;
+		case FREE:
+			live -= trace->block_sizes[index];
+			break;
+		}
+		if (live > max)
+		{
+			max = live;
+			peak = i;
 		}
 	}
+	return peak;
+}
 
-	/* As far as we know, this is a valid malloc package */
-	return 1;
+/*
+ * analyze_heap - Print the heap analysis after op opnum (-H) and write
+ *     the heap map (-M). The report goes out in one write so that the
+ *     reports of parallel workers (-j) don't interleave.
+ */
+static void analyze_heap(trace_t *trace, int tracenum, int opnum)
+{
+	heapstat_t hs;
+	char path[MAXLINE];
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp;
+
+	/* heapstat needs to walk the heap and to know the block sizes */
+	if (!mm_engine->heap_walk || !mm_engine->usable_size || !mm_engine->block_size)
+		return;
+
+	if (heap_report)
+	{
+		if (heapstat_collect(&hs, trace->blocks, trace->block_sizes,
+							 trace->num_ids) < 0)
+			unix_error("heapstat_collect failed");
+		if ((fp = open_memstream(&buf, &len)) == NULL)
+			unix_error("open_memstream failed in analyze_heap");
+		fprintf(fp, "\nHeap of trace %d at its peak (op %d, %s):\n", tracenum, opnum,
+				mm_engine->name);
+		heapstat_print(fp, &hs);
+		fclose(fp);
+		fflush(stdout);
+		if (write(STDOUT_FILENO, buf, len) < 0)
+			unix_error("write failed in analyze_heap");
+		free(buf);
+	}
+	if (heap_map)
+	{
+		snprintf(path, MAXLINE, "%s%d.ppm", heap_map, tracenum);
+		heapstat_map(path, trace->blocks, trace->block_sizes, trace->num_ids);
+	}
+}
+
+/*
+ * init_profile - Start the heap profile of one trace
+ */
+static void init_profile(profile_t *prof)
+{
+	memset(prof, 0, sizeof(*prof));
+	if (profile_fd >= 0 &&
+		(prof->fp = open_memstream(&prof->buf, &prof->len)) == NULL)
+		unix_error("open_memstream failed in init_profile");
 }
 
 /*
- * eval_mm_util - Evaluate the space utilization of the student's package
- *   The idea is to remember the high water mark "hwm" of the heap for
- *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ * sample_heap - Record the state of the heap after op opnum, when the
+ *     payloads of all allocated blocks add up to live bytes. External
+ *     fragmentation is the share of free heap bytes that are not in the
+ *     largest free block, i.e. that a single large request can't use.
+ */
+static void sample_heap(profile_t *prof, int tracenum, int opnum, int live)
+{
+	size_t heapsize = mem_heapsize();
+	size_t nfree, free_bytes, largest;
+	double util, frag;
+
+	if (mm_engine->freeinfo)
+		mm_engine->freeinfo(&nfree, &free_bytes, &largest);
+	else
+		nfree = free_bytes = largest = 0;
+	util = heapsize ? (double)live / heapsize : 0;
+	frag = free_bytes ? 1.0 - (double)largest / free_bytes : 0;
+
+	prof->samples++;
+	prof->util_sum += util;
+	if (frag > prof->peak_frag)
+		prof->peak_frag = frag;
+	if (prof->fp)
+		fprintf(prof->fp, "%d,%d,%d,%lu,%lu,%lu,%lu,%.6f,%.6f\n",
+				tracenum, opnum, live, (unsigned long)heapsize,
+				(unsigned long)nfree, (unsigned long)free_bytes,
+				(unsigned long)largest, util, frag);
+}
+
+/*
+ * finish_profile - Store the summary of the heap profile in stats and
+ *     append its samples to the profile file. A single write to an
+ *     O_APPEND file keeps the rows of one trace together even when
+ *     several workers (-j) share the file.
+ */
+static void finish_profile(profile_t *prof, stats_t *stats)
+{
+	stats->avg_util = prof->samples ? prof->util_sum / prof->samples : 0;
+	stats->peak_frag = prof->peak_frag;
+	if (prof->fp)
+	{
+		fclose(prof->fp);
+		if (write(profile_fd, prof->buf, prof->len) != (ssize_t)prof->len)
+			unix_error("write failed in finish_profile");
+		free(prof->buf);
+	}
+}
+
+/*
+ * eval_mm_check - Check the mm malloc package for correctness and
+ *   evaluate its space utilization, in one pass over the trace.
+ *
+ *   Every block must be aligned, lie in the heap and not overlap any
+ *   allocated block; its payload is filled with the low byte of its
+ *   index, and realloc must preserve it. Returns 1 if the trace ran
+ *   correctly, 0 after reporting the first error.
+ *
+ *   The idea of utilization is to remember the high water mark "hwm"
+ *   of the heap for an optimal allocator, i.e., no gaps and no internal
+ *   fragmentation. Utilization is the ratio hwm/heapsize, where
+ *   heapsize is the size of the heap in bytes after running the
+ *   student's malloc package on the trace. Note that our
+ *   implementation of mem_sbrk() doesn't allow the students to
+ *   decrement the brk pointer, so brk is always the high water mark of
+ *   the heap. It goes to stats->util, with the engine's counters and
+ *   the bytes moved by reallocs.
+ *
+ *   With -p, the heap is also sampled every profile_interval ops (and
+ *   after the last op) to record how utilization and fragmentation
+ *   evolve during the run; see sample_heap.
  *
+ *   The engine is synced right after init, which for an engine with
+ *   a maintenance thread keeps the thread off the heap and has frees
+ *   done at once, so that where blocks land depends on the trace alone
+ *   and not on when the thread happens to run.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static int eval_mm_check(trace_t *trace, int tracenum, range_t **ranges,
+						 stats_t *stats)
 {
 	int i;
 	int index;
-	int size, newsize, oldsize;
+	int size;
+	int oldsize;
 	int max_total_size = 0;
 	int total_size = 0;
+	char *newp;
+	char *oldp;
 	char *p;
-	char *newp, *oldp;
+	profile_t prof;
+	int peak = -1;
 
-	/* initialize the heap and the mm malloc package */
-	mem_reset_brk();
-	if (mm_init() < 0)
-		app_error("mm_init failed in eval_mm_util");
+	/* Free any records in the range list */
+	clear_ranges(ranges);
 
+	/* Reset the heap and call the mm package's init function */
+	if (start_heap(mm_engine, 0) < 0)
+	{
+		malloc_error(tracenum, 0, "mm_init failed.");
+		return 0;
+	}
+	if (mm_engine->sync)
+		mm_engine->sync();
+	if (profile_interval > 0)
+		init_profile(&prof);
+	if (heap_report || heap_map)
+	{
+		peak = peak_op(trace);
+		memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+	}
+
+	/* Interpret each operation in the trace in order */
 	for (i = 0; i < trace->num_ops; i++)
 	{
+		if (profile_interval > 0 && i > 0 && i % profile_interval == 0)
+			sample_heap(&prof, tracenum, i, total_size);
+
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+
 		switch (trace->ops[i].type)
 		{
 
-		case ALLOC: /* mm_alloc */
-			index = trace->ops[i].index;
-			size = trace->ops[i].size;
+		case ALLOC: /* mm_malloc */
 
-			if ((p = mm_malloc(size)) == NULL)
-				app_error("mm_malloc failed in eval_mm_util");
+			/* Call the student's malloc */
+			if ((p = mm_engine->malloc(size)) == NULL)
+			{
+				malloc_error(tracenum, i, "mm_malloc failed.");
+				goto invalid;
+			}
 
-			/* Remember region and size */
+			/*
+			 * Test the range of the new block for correctness and add it
+			 * to the range list if OK. The block must be  be aligned properly,
+			 * and must not overlap any currently allocated block.
+			 */
+			if (add_range(ranges, p, size, tracenum, i) == 0)
+				goto invalid;
+
+			/* ADDED: cgw
+			 * fill range with low byte of index.  This will be used later
+			 * if we realloc the block and wish to make sure that the old
+			 * data was copied to the new block
+			 */
+			memset(p, index & 0xFF, size);
+
+			/* Remember region */
 			trace->blocks[index] = p;
 			trace->block_sizes[index] = size;
 
 			/* Keep track of current total size
 			 * of all allocated blocks */
 			total_size += size;
-
-			/* Update statistics */
-			max_total_size = (total_size > max_total_size) ? total_size : max_total_size;
 			break;
 
 		case REALLOC: /* mm_realloc */
-			index = trace->ops[i].index;
-			newsize = trace->ops[i].size;
-			oldsize = trace->block_sizes[index];
 
+			/* Call the student's realloc */
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, newsize)) == NULL)
-				app_error("mm_realloc failed in eval_mm_util");
+			if ((newp = mm_engine->realloc(oldp, size)) == NULL)
+			{
+				malloc_error(tracenum, i, "mm_realloc failed.");
+				goto invalid;
+			}
 
-			/* Remember region and size */
-			trace->blocks[index] = newp;
-			trace->block_sizes[index] = newsize;
+			/* Remove the old region from the range list */
+			remove_range(ranges, oldp);
 
-			/* Keep track of current total size
-			 * of all allocated blocks */
-			total_size += (newsize - oldsize);
+			/* Check new block for correctness and add it to range list */
+			if (add_range(ranges, newp, size, tracenum, i) == 0)
+				goto invalid;
+
+			/* ADDED: cgw
+			 * Make sure that the new block contains the data from the old
+			 * block and then fill in the new block with the low order byte
+			 * of the new index. The preserved part already holds that
+			 * byte, so only the grown part needs filling.
+			 */
+			oldsize = trace->block_sizes[index];
+			total_size += size - oldsize;
+			if (size < oldsize)
+				oldsize = size;
+			if (newp != oldp)
+				stats->moved_bytes += oldsize;
+			if (!check_payload(newp, index & 0xFF, oldsize))
+			{
+				malloc_error(tracenum, i, "mm_realloc did not preserve the "
+										  "data from old block");
+				goto invalid;
+			}
+			if (size > oldsize)
+				memset(newp + oldsize, index & 0xFF, size - oldsize);
 
-			/* Update statistics */
-			max_total_size = (total_size > max_total_size) ? total_size : max_total_size;
+			/* Remember region */
+			trace->blocks[index] = newp;
+			trace->block_sizes[index] = size;
 			break;
 
 		case FREE: /* mm_free */
-			index = trace->ops[i].index;
-			size = trace->block_sizes[index];
-			p = trace->blocks[index];
-
-			mm_free(p);
-
-			/* Keep track of current total size
-			 * of all allocated blocks */
-			total_size -= size;
 
+			/* Remove region from list and call student's free function */
+			p = trace->blocks[index];
+			remove_range(ranges, p);
+			mm_engine->free(p);
+			trace->blocks[index] = NULL;
+			total_size -= trace->block_sizes[index];
 			break;
 
 		default:
-			app_error("Nonexistent request type in eval_mm_util");
+			app_error("Nonexistent request type in eval_mm_check");
 		}
+
+		/* Update statistics */
+		if (total_size > max_total_size)
+			max_total_size = total_size;
+		if (i == peak)
+			analyze_heap(trace, tracenum, i);
 	}
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	if (profile_interval > 0)
+	{
+		sample_heap(&prof, tracenum, trace->num_ops, total_size);
+		finish_profile(&prof, stats);
+	}
+	if (mm_engine->get_stats)
+		mm_engine->get_stats(&stats->counters);
+	stats->util = (double)max_total_size / (double)mem_heapsize();
+
+	/* As far as we know, this is a valid malloc package */
+	return 1;
+
+invalid:
+	if (profile_interval > 0 && prof.fp)
+	{
+		fclose(prof.fp);
+		free(prof.buf);
+	}
+	return 0;
+}
+
+/*
+ * eval_mm_memalign - The traces have no memalign requests, so check the
+ *     engine's mm_memalign (if it has one) on a heap of its own: every
+ *     power-of-two alignment from 16 to 4096, with sizes up to
+ *     MEMALIGN_MAX_SIZE that cross its block size rounding (size
+ *     classes too). The blocks stay
+ *     live until the end, filled with their index, so a block that
+ *     spills into its neighbour shows up as a clobbered payload.
+ */
+static void eval_mm_memalign(mm_engine_t *e)
+{
+	char *p[MEMALIGN_CHECKS];
+	size_t align, size[MEMALIGN_CHECKS];
+	int i, bad = 0;
+
+	if (e->memalign == NULL)
+		return;
+	if (start_heap(e, 0) < 0)
+		app_error("mm_init failed in eval_mm_memalign");
+	for (i = 0; i < MEMALIGN_CHECKS; i++)
+	{
+		align = (size_t)16 << (i % 9);
+		size[i] = 1 + (size_t)i * 97 % MEMALIGN_MAX_SIZE;
+		p[i] = e->memalign(align, size[i]);
+		if (p[i] == NULL || (size_t)p[i] % align != 0 ||
+			p[i] < (char *)mem_heap_lo() ||
+			p[i] + size[i] - 1 > (char *)mem_heap_hi())
+		{
+			printf("ERROR [%s]: mm_memalign(%lu, %lu) returned %p\n", e->name,
+				   (unsigned long)align, (unsigned long)size[i], p[i]);
+			bad = 1;
+			break;
+		}
+		memset(p[i], i & 0xFF, size[i]);
+	}
+	for (i--; i >= 0 && !bad; i--)
+		if (!check_bytes((unsigned char *)p[i], i & 0xFF, size[i]))
+		{
+			printf("ERROR [%s]: payload of mm_memalign(%lu, %lu) was overwritten\n",
+				   e->name, (unsigned long)16 << (i % 9), (unsigned long)size[i]);
+			bad = 1;
+		}
+	if (bad)
+		errors++;
+	else
+		for (i = 0; i < MEMALIGN_CHECKS; i++)
+			e->free(p[i]);
 }
 
 /*
@@ -831,10 +1544,10 @@ static void eval_mm_speed(void *ptr)
 	int i, index, size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
+	mm_engine_t *e = ((speed_t *)ptr)->engine;
 
 	/* Reset the heap and initialize the mm package */
-	mem_reset_brk();
-	if (mm_init() < 0)
+	if (start_heap(e, 0) < 0)
 		app_error("mm_init failed in eval_mm_speed");
 
 	/* Interpret each trace request */
@@ -845,7 +1558,7 @@ static void eval_mm_speed(void *ptr)
 		case ALLOC: /* mm_malloc */
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = e->malloc(size)) == NULL)
 				app_error("mm_malloc error in eval_mm_speed");
 			trace->blocks[index] = p;
 			break;
@@ -854,7 +1567,7 @@ static void eval_mm_speed(void *ptr)
 			index = trace->ops[i].index;
 			newsize = trace->ops[i].size;
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, newsize)) == NULL)
+			if ((newp = e->realloc(oldp, newsize)) == NULL)
 				app_error("mm_realloc error in eval_mm_speed");
 			trace->blocks[index] = newp;
 			break;
@@ -862,12 +1575,296 @@ static void eval_mm_speed(void *ptr)
 		case FREE: /* mm_free */
 			index = trace->ops[i].index;
 			block = trace->blocks[index];
-			mm_free(block);
+			e->free(block);
 			break;
 
 		default:
-			app_error("Nonexistent request type in eval_mm_valid");
+			app_error("Nonexistent request type in eval_mm_speed");
+		}
+}
+
+/*
+ * eval_mm_latency - Replay the trace, in whole runs of LAT_OPS or more
+ *     ops, timing each allocator call into stats->lat (-L). The time of
+ *     an empty pair of clock reads is taken off every sample. Each run
+ *     starts on a heap whose pages went back to the OS, as in a new
+ *     process, and the page faults each call takes are counted.
+ */
+static void eval_mm_latency(trace_t *trace, mm_engine_t *e, stats_t *stats)
+{
+	struct timespec t0, t1;
+	double overhead = lat_overhead();
+	int i, r, runs, index;
+	long before, faults;
+	char *p;
+
+	runs = (LAT_OPS + trace->num_ops - 1) / trace->num_ops;
+	for (r = 0; r < runs; r++)
+	{
+		if (start_heap(e, 1) < 0)
+			app_error("mm_init failed in eval_mm_latency");
+		for (i = 0; i < trace->num_ops; i++)
+		{
+			index = trace->ops[i].index;
+			p = NULL;
+			before = thread_faults();
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			switch (trace->ops[i].type)
+			{
+			case ALLOC:
+				p = e->malloc(trace->ops[i].size);
+				break;
+			case REALLOC:
+				p = e->realloc(trace->blocks[index], trace->ops[i].size);
+				break;
+			case FREE:
+				e->free(trace->blocks[index]);
+				break;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			if (trace->ops[i].type != FREE)
+			{
+				if (p == NULL)
+					app_error("mm_malloc error in eval_mm_latency");
+				trace->blocks[index] = p;
+			}
+			lat_add(&stats->lat, (t1.tv_sec - t0.tv_sec) * 1e9 +
+									 (t1.tv_nsec - t0.tv_nsec) - overhead);
+			if ((faults = thread_faults() - before) > 0)
+			{
+				stats->lat.faults += faults;
+				stats->lat.faulted++;
+			}
+		}
+	}
+}
+
+/*
+ * thread_faults - Page faults the calling thread has taken so far
+ */
+static long thread_faults(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_THREAD, &ru) < 0)
+		unix_error("getrusage failed in thread_faults");
+	return ru.ru_minflt + ru.ru_majflt;
+}
+
+/*
+ * eval_mm_locality - Replay the trace, in whole runs of LOC_OPS or more
+ *     ops, the way an application would use the blocks: each new block
+ *     (and the grown part of a realloc) is written in full, and every
+ *     LOC_PERIOD ops LOC_SAMPLE live blocks are read, one word per cache
+ *     line. The samples come from a fixed sequence, so every engine
+ *     reads the same blocks. stats gets the time of the whole replay and
+ *     its cache and TLB misses (-1 where the machine can't count them),
+ *     and the mean number of pages holding live blocks at LOC_SNAPS
+ *     points per run, which are not timed (-A).
+ */
+static void eval_mm_locality(trace_t *trace, mm_engine_t *e, stats_t *stats)
+{
+	struct timespec t0, t1;
+	int fd[2], *live, *pos;
+	int i, j, r, runs, index, nlive, nsnaps = 0;
+	unsigned long seed;
+	size_t old, k, live_bytes = 0, page = mem_pagesize();
+	double secs = 0, pages = 0, min_pages = 0;
+	char *p;
+	volatile char *q; /* so that the reads stay */
+
+	fd[0] = pmu_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	fd[1] = pmu_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+											 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+											 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	live = malloc(trace->num_ids * sizeof(int));
+	pos = malloc(trace->num_ids * sizeof(int));
+	if (live == NULL || pos == NULL)
+		unix_error("malloc failed in eval_mm_locality");
+
+	runs = (LOC_OPS + trace->num_ops - 1) / trace->num_ops;
+	for (r = 0; r < runs; r++)
+	{
+		if (start_heap(e, 0) < 0)
+			app_error("mm_init failed in eval_mm_locality");
+		nlive = 0;
+		live_bytes = 0;
+		seed = 1;
+		pmu_enable(fd, 2, 1);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (i = 0; i < trace->num_ops; i++)
+		{
+			index = trace->ops[i].index;
+			switch (trace->ops[i].type)
+			{
+			case ALLOC:
+				if ((p = e->malloc(trace->ops[i].size)) == NULL)
+					app_error("mm_malloc error in eval_mm_locality");
+				memset(p, index, trace->ops[i].size);
+				pos[index] = nlive;
+				live[nlive++] = index;
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = trace->ops[i].size;
+				live_bytes += trace->ops[i].size;
+				break;
+			case REALLOC:
+				old = trace->block_sizes[index];
+				if ((p = e->realloc(trace->blocks[index], trace->ops[i].size)) == NULL)
+					app_error("mm_realloc error in eval_mm_locality");
+				if (trace->ops[i].size > old)
+					memset(p + old, index, trace->ops[i].size - old);
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = trace->ops[i].size;
+				live_bytes = live_bytes - old + trace->ops[i].size;
+				break;
+			case FREE:
+				e->free(trace->blocks[index]);
+				live[pos[index]] = live[--nlive];
+				pos[live[nlive]] = pos[index];
+				live_bytes -= trace->block_sizes[index];
+				break;
+			}
+
+			/* Read a sample of the live blocks */
+			if (i % LOC_PERIOD == 0)
+				for (j = 0; j < LOC_SAMPLE && nlive > 0; j++)
+				{
+					seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+					index = live[(seed >> 33) % nlive];
+					q = trace->blocks[index];
+					for (k = 0; k < trace->block_sizes[index]; k += 64)
+						(void)q[k];
+				}
+
+			/* Count the pages of the live blocks, off the clock */
+			if ((i + 1) % ((trace->num_ops + LOC_SNAPS - 1) / LOC_SNAPS) == 0)
+			{
+				clock_gettime(CLOCK_MONOTONIC, &t1);
+				pmu_enable(fd, 2, 0);
+				secs += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+				pages += live_pages(trace, live, nlive);
+				min_pages += (double)(live_bytes + page - 1) / page;
+				nsnaps++;
+				pmu_enable(fd, 2, 1);
+				clock_gettime(CLOCK_MONOTONIC, &t0);
+			}
 		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		pmu_enable(fd, 2, 0);
+		secs += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	}
+
+	stats->loc_ops = (double)runs * trace->num_ops;
+	stats->loc_secs = secs;
+	stats->loc_misses = pmu_read(fd[0]);
+	stats->loc_tlb = pmu_read(fd[1]);
+	stats->loc_pages = nsnaps ? pages / nsnaps : 0;
+	stats->loc_min_pages = nsnaps ? min_pages / nsnaps : 0;
+	for (j = 0; j < 2; j++)
+		if (fd[j] >= 0)
+			close(fd[j]);
+	free(live);
+	free(pos);
+}
+
+/*
+ * live_pages - The number of heap pages that hold some of the nlive
+ *     blocks whose indexes are in live
+ */
+static long live_pages(trace_t *trace, int *live, int nlive)
+{
+	static unsigned char *map = NULL;
+	static size_t map_len = 0;
+	size_t page = mem_pagesize(), len, first, last, pg;
+	char *lo = mem_heap_lo();
+	long n = 0;
+	int i;
+
+	len = (mem_heapsize() + page - 1) / page;
+	if (len > map_len)
+	{
+		free(map);
+		if ((map = malloc(len)) == NULL)
+			unix_error("malloc failed in live_pages");
+		map_len = len;
+	}
+	memset(map, 0, len);
+	for (i = 0; i < nlive; i++)
+	{
+		if (trace->block_sizes[live[i]] == 0)
+			continue;
+		first = (trace->blocks[live[i]] - lo) / page;
+		last = (trace->blocks[live[i]] + trace->block_sizes[live[i]] - 1 - lo) / page;
+		for (pg = first; pg <= last && pg < len; pg++)
+			if (!map[pg])
+			{
+				map[pg] = 1;
+				n++;
+			}
+	}
+	return n;
+}
+
+/*
+ * pmu_open - Open a counter of event config of the given type for the
+ *     calling thread, disabled and counting user mode only. -1 if the
+ *     machine has no such counter or won't let us use it.
+ */
+static int pmu_open(unsigned int type, unsigned long config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * pmu_enable - Start (on) or stop the n counters in fd that are open
+ */
+static void pmu_enable(int *fd, int n, int on)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (fd[i] >= 0)
+			ioctl(fd[i], on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+}
+
+/*
+ * pmu_read - The count of counter fd, or -1 if it isn't open
+ */
+static double pmu_read(int fd)
+{
+	unsigned long long count;
+
+	if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+		return -1;
+	return (double)count;
+}
+
+/*
+ * start_heap - Reset the heap and initialize engine e on it. The engine
+ *     that had the heap before finishes its deferred work first, so
+ *     that none of it lands in the heap once e owns it. A cold heap
+ *     gives its pages back to the OS first, so they fault again.
+ */
+static int start_heap(mm_engine_t *e, int cold)
+{
+	static mm_engine_t *owner = NULL;
+
+	if (owner != NULL && owner->sync)
+		owner->sync();
+	owner = e;
+	mem_reset_brk();
+	if (cold)
+		mem_release();
+	return e->init();
 }
 
 /*
@@ -965,6 +1962,21 @@ static void eval_libc_speed(void *ptr)
  * Some miscellaneous helper routines
  ************************************/
 
+/*
+ * thruput_ci - Half-width (in Kops) of the confidence interval of the
+ *     throughput ops/secs, given the half-width ci of secs. The interval
+ *     is asymmetric in throughput; we report its wider (lower) side,
+ *     which is unbounded when the interval of secs reaches 0.
+ */
+static double thruput_ci(double ops, double secs, double ci)
+{
+	if (ci <= 0)
+		return 0;
+	if (ci >= secs)
+		return HUGE_VAL;
+	return (ops / 1e3) / (secs - ci) - (ops / 1e3) / secs;
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -974,33 +1986,37 @@ static void printresults(int n, stats_t *stats)
 	double secs = 0;
 	double ops = 0;
 	double util = 0;
+	double var = 0;
 
 	/* Print the individual results for each trace */
-	printf("%5s%7s %5s%8s%10s%6s\n",
-		   "trace", " valid", "util", "ops", "secs", "Kops");
+	printf("%5s%7s %5s%8s%10s%6s%7s\n",
+		   "trace", " valid", "util", "ops", "secs", "Kops", "+/-");
 	for (i = 0; i < n; i++)
 	{
 		if (stats[i].valid)
 		{
-			printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n",
+			printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f%7.0f\n",
 				   i,
 				   "yes",
 				   stats[i].util * 100.0,
 				   stats[i].ops,
 				   stats[i].secs,
-				   (stats[i].ops / 1e3) / stats[i].secs);
+				   (stats[i].ops / 1e3) / stats[i].secs,
+				   thruput_ci(stats[i].ops, stats[i].secs, stats[i].ci));
 			secs += stats[i].secs;
 			ops += stats[i].ops;
 			util += stats[i].util;
+			var += stats[i].ci * stats[i].ci;
 		}
 		else
 		{
-			printf("%2d%10s%6s%8s%10s%6s\n",
+			printf("%2d%10s%6s%8s%10s%6s%7s\n",
 				   i,
 				   "no",
 				   "-",
 				   "-",
 				   "-",
+				   "-",
 				   "-");
 		}
 	}
@@ -1008,24 +2024,261 @@ static void printresults(int n, stats_t *stats)
 	/* Print the aggregate results for the set of traces */
 	if (errors == 0)
 	{
-		printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n",
+		printf("%12s%5.0f%%%8.0f%10.6f%6.0f%7.0f\n",
 			   "Total       ",
 			   (util / n) * 100.0,
 			   ops,
 			   secs,
-			   (ops / 1e3) / secs);
+			   (ops / 1e3) / secs,
+			   thruput_ci(ops, secs, sqrt(var)));
 	}
 	else
 	{
-		printf("%12s%6s%8s%10s%6s\n",
+		printf("%12s%6s%8s%10s%6s%7s\n",
 			   "Total       ",
 			   "-",
 			   "-",
 			   "-",
+			   "-",
 			   "-");
 	}
 }
 
+/*
+ * perf_index - The performance index of an allocator from its stats on
+ *     n traces: utilization and throughput (capped at that of libc)
+ *     weighted by weight and 1 - weight (UTIL_WEIGHT for the score).
+ *     Returns it in percent, and the two parts as fractions in *p1 and
+ *     *p2.
+ */
+static double perf_index(int n, stats_t *stats, double weight, double *p1,
+						 double *p2)
+{
+	double secs = 0, ops = 0, util = 0, thruput;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		secs += stats[i].secs;
+		ops += stats[i].ops;
+		util += stats[i].util;
+	}
+	thruput = ops / secs;
+	*p1 = weight * (util / n);
+	if (thruput > AVG_LIBC_THRUPUT)
+		*p2 = 1.0 - weight;
+	else
+		*p2 = (1.0 - weight) * (thruput / AVG_LIBC_THRUPUT);
+	return (*p1 + *p2) * 100.0;
+}
+
+/*
+ * printcompare - Print utilization and throughput of each engine side by
+ *     side, one row per trace (stats holds n traces per engine)
+ */
+static void printcompare(int n, mm_engine_t **engines, int nengines,
+						 stats_t *stats)
+{
+	double p1, p2, util, secs, ops;
+	int i, e, valid;
+	stats_t *st;
+
+	printf("\nEngine comparison (util, Kops):\n");
+	printf("%5s", "trace");
+	for (e = 0; e < nengines; e++)
+		printf("%18.17s", engines[e]->name);
+	printf("\n");
+	for (i = 0; i < n; i++)
+	{
+		printf("%2d%3s", i, "");
+		for (e = 0; e < nengines; e++)
+		{
+			st = &stats[e * n + i];
+			if (st->valid)
+				printf("%7.0f%%%10.0f", st->util * 100.0, (st->ops / 1e3) / st->secs);
+			else
+				printf("%8s%10s", "-", "-");
+		}
+		printf("\n");
+	}
+
+	printf("%-5s", "Total");
+	for (e = 0; e < nengines; e++)
+	{
+		util = secs = ops = 0;
+		for (i = 0, valid = 1; i < n; i++)
+		{
+			st = &stats[e * n + i];
+			valid &= st->valid;
+			util += st->util;
+			secs += st->secs;
+			ops += st->ops;
+		}
+		if (valid)
+			printf("%7.0f%%%10.0f", util / n * 100.0, (ops / 1e3) / secs);
+		else
+			printf("%8s%10s", "-", "-");
+	}
+	printf("\n%-5s", "Perf");
+	for (e = 0; e < nengines; e++)
+	{
+		for (i = 0, valid = 1; i < n; i++)
+			valid &= stats[e * n + i].valid;
+		if (valid)
+			printf("%18.0f", perf_index(n, &stats[e * n], UTIL_WEIGHT, &p1, &p2));
+		else
+			printf("%18s", "-");
+	}
+	printf("\n");
+}
+
+/*
+ * printcounters - Print the mm.c event counters of each trace, the
+ *     search steps per op and the rest as totals
+ */
+static void printcounters(int n, stats_t *stats)
+{
+	int i;
+	mm_stats_t *c;
+
+	printf("\nAllocator counters (utilization pass):\n");
+	printf("%37s%-24s%s\n", "", "   ---- coalesce ----",
+		   "  ------------- realloc -------------");
+	printf("%5s%8s%8s%8s%8s%6s%6s%6s%6s%6s%6s%10s%10s%10s\n", "trace", "fit/op", "ins/op",
+		   "splits", "extends", "none", "next", "prev", "both", "kept", "moved",
+		   "moved KB", "copied KB", "remap KB");
+	for (i = 0; i < n; i++)
+	{
+		c = &stats[i].counters;
+		if (!stats[i].valid)
+		{
+			printf("%2d%11s\n", i, "-");
+			continue;
+		}
+		printf("%2d%11.1f%8.1f%8lu%8lu%6lu%6lu%6lu%6lu%6lu%6lu%10.0f%10.0f%10.0f\n",
+			   i, c->fit_steps / stats[i].ops, c->insert_steps / stats[i].ops,
+			   c->splits, c->extends,
+			   c->coalesce[0], c->coalesce[1], c->coalesce[2], c->coalesce[3],
+			   c->realloc_inplace, c->realloc_copy, stats[i].moved_bytes / 1024.0,
+			   c->bytes_copied / 1024.0, c->bytes_remapped / 1024.0);
+	}
+}
+
+/*
+ * printprofile - prints the heap profile summary of each trace (-p)
+ */
+static void printprofile(int n, stats_t *stats)
+{
+	int i;
+
+	printf("\nHeap profile (every %d ops):\n", profile_interval);
+	printf("%5s%9s%9s%10s\n", "trace", "util", "avgutil", "peakfrag");
+	for (i = 0; i < n; i++)
+	{
+		if (stats[i].valid)
+			printf("%2d%11.0f%%%8.0f%%%9.0f%%\n",
+				   i,
+				   stats[i].util * 100.0,
+				   stats[i].avg_util * 100.0,
+				   stats[i].peak_frag * 100.0);
+		else
+			printf("%2d%12s%9s%10s\n", i, "-", "-", "-");
+	}
+}
+
+/*
+ * printlocality - Print the time, misses and live-block pages of the
+ *     replay that touches the payloads (-A), per trace and in total.
+ *     "spread" is the pages holding live blocks over the fewest pages
+ *     their bytes would fit in.
+ */
+static void printlocality(int n, stats_t *stats)
+{
+	double ops = 0, secs = 0, misses = 0, tlb = 0, pages = 0, min_pages = 0;
+	int i;
+
+	printf("%5s%10s%10s%9s%12s%12s%9s%9s%8s\n", "trace", "ops", "secs", "Kops",
+		   "misses", "dTLB miss", "pages", "min", "spread");
+	for (i = 0; i < n; i++)
+	{
+		if (!stats[i].valid)
+		{
+			printf("%2d%13s\n", i, "-");
+			continue;
+		}
+		printf("%2d%3s", i, "");
+		printloc(stats[i].loc_ops, stats[i].loc_secs, stats[i].loc_misses,
+				 stats[i].loc_tlb, stats[i].loc_pages, stats[i].loc_min_pages);
+		ops += stats[i].loc_ops;
+		secs += stats[i].loc_secs;
+		misses = (misses < 0 || stats[i].loc_misses < 0) ? -1 : misses + stats[i].loc_misses;
+		tlb = (tlb < 0 || stats[i].loc_tlb < 0) ? -1 : tlb + stats[i].loc_tlb;
+		pages += stats[i].loc_pages;
+		min_pages += stats[i].loc_min_pages;
+	}
+	printf("%-5s", "Total");
+	printloc(ops, secs, misses, tlb, pages, min_pages);
+}
+
+/*
+ * printloc - One row of printlocality; counts of -1 print as "-"
+ */
+static void printloc(double ops, double secs, double misses, double tlb,
+					 double pages, double min_pages)
+{
+	printf("%10.0f%10.6f%9.0f", ops, secs, secs > 0 ? ops / secs / 1e3 : 0);
+	if (misses < 0)
+		printf("%12s", "-");
+	else
+		printf("%12.0f", misses);
+	if (tlb < 0)
+		printf("%12s", "-");
+	else
+		printf("%12.0f", tlb);
+	printf("%9.1f%9.1f%8.2f\n", pages, min_pages, min_pages > 0 ? pages / min_pages : 0);
+}
+
+/*
+ * printlatency - Print the quantiles of the call times (in ns) of each
+ *     trace and of all of them (-L), with the page faults taken inside
+ *     the calls and how many calls took them, and the histogram of all
+ */
+static void printlatency(int n, stats_t *stats)
+{
+	lat_hist_t all;
+	lat_hist_t *h;
+	int i;
+
+	memset(&all, 0, sizeof(all));
+	printf("%5s%10s%9s%9s%9s%9s%9s%11s%9s%9s\n", "trace", "calls", "mean", "p50",
+		   "p90", "p99", "p99.9", "max", "faults", "faulted");
+	for (i = 0; i <= n; i++)
+	{
+		h = (i < n) ? &stats[i].lat : &all;
+		if (i < n && !stats[i].valid)
+		{
+			printf("%2d%13s\n", i, "-");
+			continue;
+		}
+		if (i < n)
+		{
+			printf("%2d%3s", i, "");
+			lat_merge(&all, h);
+		}
+		else
+			printf("%-5s", "Total");
+		printf("%10lu%9.0f%9.0f%9.0f%9.0f%9.0f%11.0f%9lu%9lu\n", h->n,
+			   h->n ? h->sum / h->n : 0, lat_quantile(h, 0.5), lat_quantile(h, 0.9),
+			   lat_quantile(h, 0.99), lat_quantile(h, 0.999), h->max, h->faults,
+			   h->faulted);
+	}
+	if (all.n > 0)
+	{
+		printf("\n");
+		lat_print(stdout, &all);
+	}
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1058,14 +2311,40 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+	fprintf(stderr, "Usage: mdriver [-hvValm] [-f <file>] [-t <dir>] [-c <cpu>] [-e <eng>]...\n");
+	fprintf(stderr, "               [-w <n>] [-n <n>] [-k <k>] [-o <file>]\n");
+	fprintf(stderr, "               [-b <file>] [-r <pct>] [-j <n>] [-S]\n");
+	fprintf(stderr, "               [-p <n>] [-P <file>] [-q] [-H] [-L] [-A] [-M <prefix>]\n");
+	fprintf(stderr, "               [-T <file.h> [-G] [-W <pct>]]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-a         Don't check the team structure.\n");
+	fprintf(stderr, "\t-A         Replay writing and reading the blocks; report time, misses, pages.\n");
+	fprintf(stderr, "\t-b <file>  Compare against results saved with -o; exit 2 on regression.\n");
+	fprintf(stderr, "\t-c <cpu>   Pin the driver to CPU <cpu> while timing.\n");
+	fprintf(stderr, "\t-e <eng>   Test engine <eng>: mm, or an engine-*.so; repeat to compare.\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 	fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+	fprintf(stderr, "\t-G         With -T, try every configuration on every trace.\n");
 	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-H         Analyze the heap at the peak of each trace.\n");
+	fprintf(stderr, "\t-j <n>     Evaluate the traces in <n> pinned worker processes.\n");
+	fprintf(stderr, "\t-k <k>     Time as the mean of the <k> fastest runs.\n");
 	fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+	fprintf(stderr, "\t-L         Print a histogram of the time of each allocator call.\n");
+	fprintf(stderr, "\t-m         Time as the median run (default).\n");
+	fprintf(stderr, "\t-M <pfx>   Draw the heap at the peak of each trace to <pfx><n>.ppm.\n");
+	fprintf(stderr, "\t-n <n>     Timed runs per measurement (default 10).\n");
+	fprintf(stderr, "\t-o <file>  Write results as JSON (or CSV if <file> ends in .csv).\n");
+	fprintf(stderr, "\t-p <n>     Sample heap utilization and fragmentation every <n> ops.\n");
+	fprintf(stderr, "\t-P <file>  Write the heap samples to <file> as CSV (implies -p 100).\n");
+	fprintf(stderr, "\t-q         Check only samples of big payloads after realloc.\n");
+	fprintf(stderr, "\t-r <pct>   Regression noise threshold for -b (default 5).\n");
+	fprintf(stderr, "\t-S         With -j, run the timed runs of one worker at a time.\n");
 	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	fprintf(stderr, "\t-T <file>  Tune the allocator's parameters; write the best to <file>.\n");
 	fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
 	fprintf(stderr, "\t-V         Print additional debug info.\n");
+	fprintf(stderr, "\t-w <n>     Untimed warmup runs per measurement (default 1).\n");
+	fprintf(stderr, "\t-W <pct>   Weight of utilization in the -T goal (default %.0f).\n",
+			UTIL_WEIGHT * 100);
 }
@@ -2,7 +2,11 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap is an anonymous mapping of its own, so that
+ *            mem_remap can move pages of it around.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -18,6 +22,7 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_touched;    /* end of the pages the heap has used */
 static char *mem_heap;
 
 /* 
@@ -25,15 +30,18 @@ static char *mem_heap;
  */
 void mem_init(void)
 {
-    /* 1) OS malloc으로 한 번만 영역 확보 */
-    if ((mem_start_brk = malloc(MAX_HEAP)) == NULL) {
-        fprintf(stderr, "mem_init: malloc error\n");
+    /* 1) mmap으로 한 번만 영역 확보 (mem_remap이 페이지를 옮길 수 있게) */
+    mem_start_brk = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+        fprintf(stderr, "mem_init: mmap error\n");
         exit(1);
     }
 
     /* 2) 동일한 시작 주소를 mem_heap과 mem_brk에 세팅 */
     mem_heap     = mem_start_brk;
     mem_brk      = mem_start_brk;
+    mem_touched  = mem_start_brk;
 
     /* 3) 최대 합법 주소 계산 */
     mem_max_addr = mem_start_brk + MAX_HEAP;
@@ -44,7 +52,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, MAX_HEAP);
 }
 
 /*
@@ -74,6 +82,8 @@ void *mem_sbrk(int incr)
 	return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_brk > mem_touched)
+        mem_touched = mem_brk;
     return (void *)old_brk;
 }
 
@@ -108,3 +118,92 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_remap - copy len bytes from src to dst, like memcpy, but move the
+ *    whole pages of src by remapping them when src and dst have the same
+ *    offset within a page. The pages are swapped with the ones at dst
+ *    (through a scratch mapping), so neither side is left with fresh
+ *    pages that fault again; src reads as garbage afterwards. Returns
+ *    the number of bytes that were remapped.
+ */
+size_t mem_remap(void *dst, void *src, size_t len)
+{
+    size_t page = mem_pagesize();
+    char *s = src, *d = dst, *tmp;
+    char *lo = (char *)(((unsigned long)s + page - 1) & ~(page - 1));
+    char *hi = (char *)(((unsigned long)s + len) & ~(page - 1));
+    size_t n = hi - lo;
+
+    if ((unsigned long)(d - s) % page != 0 || hi <= lo ||
+        (tmp = mmap(NULL, n, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        memcpy(d, s, len);
+        return 0;
+    }
+    if (mremap(lo, n, n, MREMAP_MAYMOVE | MREMAP_FIXED, tmp) == MAP_FAILED ||
+        mremap(d + (lo - s), n, n, MREMAP_MAYMOVE | MREMAP_FIXED, lo) == MAP_FAILED ||
+        mremap(tmp, n, n, MREMAP_MAYMOVE | MREMAP_FIXED, d + (lo - s)) == MAP_FAILED) {
+        fprintf(stderr, "mem_remap: mremap error\n");
+        exit(1);
+    }
+    memcpy(d, s, lo - s);
+    memcpy(d + (hi - s), hi, s + len - hi);
+    return n;
+}
+
+/*
+ * mem_prefault - fault in the pages of [lo, lo+len) that lie in the
+ *    heap's address space, past the brk too, without changing what they
+ *    hold, so that the allocator's first writes to them don't fault.
+ *    MADV_POPULATE_WRITE does it in one call; kernels without it get an
+ *    atomic add of 0 to each page, which is safe against other threads
+ *    writing there. Returns the number of bytes faulted in. It doesn't
+ *    record the pages for mem_release, so it can run outside the lock
+ *    that serializes the allocator's mem_sbrk calls; the caller does
+ *    that with mem_touch once it holds the lock again.
+ */
+size_t mem_prefault(void *lo, size_t len)
+{
+    size_t page = mem_pagesize();
+    char *p = (char *)((unsigned long)lo & ~(page - 1));
+    char *hi = (char *)lo + len;
+
+    if (p < mem_start_brk)
+        p = mem_start_brk;
+    if (hi > mem_max_addr)
+        hi = mem_max_addr;
+    if (hi <= p)
+        return 0;
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(p, hi - p, MADV_POPULATE_WRITE) == 0)
+        return hi - p;
+#endif
+    for (lo = p; p < hi; p += page)
+        __atomic_fetch_add(p, 0, __ATOMIC_RELAXED);
+    return hi - (char *)lo;
+}
+
+/*
+ * mem_touch - record that the pages of the heap's address space below
+ *    hi may have been faulted in (by mem_prefault), so that mem_release
+ *    gives them back too. Not safe against a concurrent mem_sbrk.
+ */
+void mem_touch(void *hi)
+{
+    if ((char *)hi > mem_max_addr)
+        hi = mem_max_addr;
+    if ((char *)hi > mem_touched)
+        mem_touched = hi;
+}
+
+/*
+ * mem_release - give every page the heap has touched back to the OS.
+ *    They read as zeros afterwards and fault again on the next write,
+ *    as in a new process. Only for an empty heap (after mem_reset_brk).
+ */
+void mem_release(void)
+{
+    if (mem_touched > mem_start_brk)
+        madvise(mem_start_brk, mem_touched - mem_start_brk, MADV_DONTNEED);
+    mem_touched = mem_start_brk;
+}
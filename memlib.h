@@ -8,4 +8,8 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_remap(void *dst, void *src, size_t len);
+size_t mem_prefault(void *lo, size_t len);
+void mem_touch(void *hi);
+void mem_release(void);
 
@@ -0,0 +1,222 @@
+/*
+ * memlib_os.c - the memory system for the shared-library build of the
+ *     allocator (libmm.so). Same interface as memlib.c, but the heap is
+ *     a real OS mapping instead of a block taken from libc malloc:
+ *     malloc is the function being replaced, so it can't be used here.
+ *
+ *     mem_init reserves MM_HEAP_MAX bytes of address space (16 GB by
+ *     default, override with the MM_HEAP_MAX environment variable, in
+ *     MB). The reservation is MAP_NORESERVE, so pages only count
+ *     toward RSS once the allocator touches them, just like sbrk.
+ *
+ *     Nothing in this file may call malloc, directly or via stdio.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "memlib.h"
+
+#define DEFAULT_HEAP_MAX ((size_t)16 << 30) /* 16 GB of address space */
+
+/* private variables */
+static char *mem_start_brk;  /* points to first byte of heap */
+static char *mem_brk;        /* points to last byte of heap */
+static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_touched;    /* end of the pages the heap has used */
+
+/*
+ * mem_oserror - report an error without going through stdio
+ */
+static void mem_oserror(const char *msg)
+{
+    if (write(STDERR_FILENO, msg, strlen(msg)) < 0)
+        return;
+}
+
+/* 
+ * mem_init - reserve the address space for the heap. On failure the
+ *    heap is left empty, so the first mem_sbrk fails with ENOMEM.
+ */
+void mem_init(void)
+{
+    size_t max = DEFAULT_HEAP_MAX;
+    const char *env = getenv("MM_HEAP_MAX");
+    void *p;
+
+    if (env != NULL && atol(env) > 0)
+        max = (size_t)atol(env) << 20;
+
+    p = mmap(NULL, max, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        mem_oserror("mem_init: mmap failed\n");
+        p = NULL;
+        max = 0;
+    }
+
+    mem_start_brk = p;
+    mem_brk = p;
+    mem_touched = p;
+    mem_max_addr = (char *)p + max;
+}
+
+/* 
+ * mem_deinit - give the heap back to the OS
+ */
+void mem_deinit(void)
+{
+    if (mem_start_brk != NULL)
+        munmap(mem_start_brk, mem_max_addr - mem_start_brk);
+    mem_start_brk = mem_brk = mem_max_addr = mem_touched = NULL;
+}
+
+/*
+ * mem_reset_brk - reset the brk pointer to make an empty heap
+ */
+void mem_reset_brk()
+{
+    mem_brk = mem_start_brk;
+}
+
+/* 
+ * mem_sbrk - extends the heap by incr bytes and returns the start
+ *    address of the new area. The heap cannot be shrunk.
+ */
+void *mem_sbrk(int incr) 
+{
+    char *old_brk = mem_brk;
+
+    if ((incr < 0) || (mem_max_addr - mem_brk < incr)) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    mem_brk += incr;
+    if (mem_brk > mem_touched)
+        mem_touched = mem_brk;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo()
+{
+    return (void *)mem_start_brk;
+}
+
+/* 
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi()
+{
+    return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes
+ */
+size_t mem_heapsize() 
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize()
+{
+    return (size_t)getpagesize();
+}
+
+/*
+ * mem_remap - copy len bytes from src to dst, like memcpy, but move the
+ *    whole pages of src by remapping them when src and dst have the same
+ *    offset within a page. The pages are swapped with the ones at dst
+ *    (through a scratch mapping), so neither side is left with fresh
+ *    pages that fault again; src reads as garbage afterwards. Returns
+ *    the number of bytes that were remapped.
+ */
+size_t mem_remap(void *dst, void *src, size_t len)
+{
+    size_t page = mem_pagesize();
+    char *s = src, *d = dst, *tmp;
+    char *lo = (char *)(((unsigned long)s + page - 1) & ~(page - 1));
+    char *hi = (char *)(((unsigned long)s + len) & ~(page - 1));
+    size_t n = hi - lo;
+
+    if ((unsigned long)(d - s) % page != 0 || hi <= lo ||
+        (tmp = mmap(NULL, n, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        memcpy(d, s, len);
+        return 0;
+    }
+    if (mremap(lo, n, n, MREMAP_MAYMOVE | MREMAP_FIXED, tmp) == MAP_FAILED ||
+        mremap(d + (lo - s), n, n, MREMAP_MAYMOVE | MREMAP_FIXED, lo) == MAP_FAILED ||
+        mremap(tmp, n, n, MREMAP_MAYMOVE | MREMAP_FIXED, d + (lo - s)) == MAP_FAILED) {
+        mem_oserror("mem_remap: mremap failed\n");
+        abort();
+    }
+    memcpy(d, s, lo - s);
+    memcpy(d + (hi - s), hi, s + len - hi);
+    return n;
+}
+
+/*
+ * mem_prefault - fault in the pages of [lo, lo+len) that lie in the
+ *    heap's address space, past the brk too, without changing what they
+ *    hold, so that the allocator's first writes to them don't fault.
+ *    MADV_POPULATE_WRITE does it in one call; kernels without it get an
+ *    atomic add of 0 to each page, which is safe against other threads
+ *    writing there. Returns the number of bytes faulted in. It doesn't
+ *    record the pages for mem_release, so it can run outside the lock
+ *    that serializes the allocator's mem_sbrk calls; the caller does
+ *    that with mem_touch once it holds the lock again.
+ */
+size_t mem_prefault(void *lo, size_t len)
+{
+    size_t page = mem_pagesize();
+    char *p = (char *)((unsigned long)lo & ~(page - 1));
+    char *hi = (char *)lo + len;
+
+    if (p < mem_start_brk)
+        p = mem_start_brk;
+    if (hi > mem_max_addr)
+        hi = mem_max_addr;
+    if (hi <= p)
+        return 0;
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(p, hi - p, MADV_POPULATE_WRITE) == 0)
+        return hi - p;
+#endif
+    for (lo = p; p < hi; p += page)
+        __atomic_fetch_add(p, 0, __ATOMIC_RELAXED);
+    return hi - (char *)lo;
+}
+
+/*
+ * mem_touch - record that the pages of the heap's address space below
+ *    hi may have been faulted in (by mem_prefault), so that mem_release
+ *    gives them back too. Not safe against a concurrent mem_sbrk.
+ */
+void mem_touch(void *hi)
+{
+    if ((char *)hi > mem_max_addr)
+        hi = mem_max_addr;
+    if ((char *)hi > mem_touched)
+        mem_touched = hi;
+}
+
+/*
+ * mem_release - give every page the heap has touched back to the OS.
+ *    They read as zeros afterwards and fault again on the next write,
+ *    as in a new process. Only for an empty heap (after mem_reset_brk).
+ */
+void mem_release(void)
+{
+    if (mem_touched > mem_start_brk)
+        madvise(mem_start_brk, mem_touched - mem_start_brk, MADV_DONTNEED);
+    mem_touched = mem_start_brk;
+}
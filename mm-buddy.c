@@ -0,0 +1,393 @@
+/*
+ * mm-buddy.c - 이진 버디 할당기 (mm.c와 같은 인터페이스, make mdriver-buddy)
+ *
+ * 블록 크기는 2^k (k >= MIN_ORDER)이고 힙 시작에서 2^k 배수 위치에 놓인다.
+ * 블록 off의 버디는 off ^ 2^k 이므로 헤더/푸터 없이 합칠 수 있다.
+ * - 차수별 가용 리스트 (가용 블록 안에 next/prev)
+ * - 차수별 가용 비트맵: 버디가 같은 차수의 가용 블록인지 O(1)로 확인
+ * - 블록 시작 칸(16바이트)마다 차수 한 바이트
+ * 메타데이터는 힙 밖의 mmap 영역에 있으므로 mdriver의 util에는 잡히지 않는다
+ * (힙 크기의 약 1/16 + 1/8비트).
+ * malloc/free/realloc 모두 차수 수만큼만 돌므로 최악 O(log n).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "mm.h"
+#include "memlib.h"
+
+/* 팀 정보 */
+team_t team = {
+    "ateam", "Harry Bovik", "bovik@cs.cmu.edu", "", ""
+};
+
+#define MIN_ORDER 4   /* 가장 작은 블록 16바이트 = 가용 리스트 포인터 두 개 */
+#define MAX_ORDER 32  /* 힙은 최대 4GB */
+#define NORDERS (MAX_ORDER + 1)
+#define BLK(k) ((size_t)1 << (k))
+
+/* 통계 카운터 - MM_STATS 없이 빌드하면 코드가 전부 사라진다 */
+#ifdef MM_STATS
+static mm_stats_t stats;
+#define STAT_INC(field) (stats.field++)
+#define STAT_ADD(field, n) (stats.field += (n))
+#else
+#define STAT_INC(field)
+#define STAT_ADD(field, n) ((void)(n))
+#endif
+
+/* 가용 블록 안에 들어가는 리스트 노드 */
+typedef struct free_blk {
+    struct free_blk *next;
+    struct free_blk *prev;
+} free_blk;
+
+static char *base;                /* 힙 시작 (오프셋 0) */
+static size_t top;                /* 힙 끝 오프셋 */
+static free_blk *head[NORDERS];   /* 차수별 가용 리스트 */
+static unsigned long nonempty;    /* 가용 리스트가 비어 있지 않은 차수 비트 */
+static unsigned char *ord;        /* 블록 시작 칸마다 차수 */
+static uint64_t *fmap[NORDERS];   /* 차수별 가용 비트맵 */
+static size_t meta_size;
+
+#define ORD(off) ord[(off) >> MIN_ORDER]
+
+static int is_free(size_t off, int k)
+{
+    size_t i = off >> k;
+    return (fmap[k][i >> 6] >> (i & 63)) & 1;
+}
+
+/* push - off의 2^k 블록을 가용 리스트와 비트맵에 넣는다 */
+static void push(size_t off, int k)
+{
+    free_blk *b = (free_blk *)(base + off);
+    size_t i = off >> k;
+
+    b->prev = NULL;
+    b->next = head[k];
+    if (head[k] != NULL)
+        head[k]->prev = b;
+    head[k] = b;
+    nonempty |= 1UL << k;
+    fmap[k][i >> 6] |= (uint64_t)1 << (i & 63);
+    ORD(off) = k;
+}
+
+/* unlink_blk - 가용 리스트와 비트맵에서 뺀다 */
+static void unlink_blk(size_t off, int k)
+{
+    free_blk *b = (free_blk *)(base + off);
+    size_t i = off >> k;
+
+    if (b->prev != NULL)
+        b->prev->next = b->next;
+    else
+        head[k] = b->next;
+    if (b->next != NULL)
+        b->next->prev = b->prev;
+    if (head[k] == NULL)
+        nonempty &= ~(1UL << k);
+    fmap[k][i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+/* free_block - 버디가 가용이면 계속 합치고 가용 리스트에 넣는다
+ * (통계: 위 버디와 합치면 next, 아래 버디면 prev, 못 합치면 none) */
+static void free_block(size_t off, int k)
+{
+    size_t buddy;
+    int merged = 0;
+
+    for (; k < MAX_ORDER; k++) {
+        buddy = off ^ BLK(k);
+        if (buddy + BLK(k) > top || !is_free(buddy, k))
+            break;
+        unlink_blk(buddy, k);
+        STAT_INC(coalesce[buddy > off ? 1 : 2]);
+        off &= ~BLK(k);
+        merged = 1;
+    }
+    if (!merged)
+        STAT_INC(coalesce[0]);
+    push(off, k);
+}
+
+/* take - k 이상인 가장 작은 가용 블록을 쪼개서 2^k 블록을 꺼낸다, 없으면 -1 */
+static long take(int k)
+{
+    unsigned long m = nonempty >> k << k;
+    size_t off;
+    int j;
+
+    if (m == 0)
+        return -1;
+    j = __builtin_ctzl(m);
+    STAT_ADD(fit_steps, j - k + 1);
+    off = (char *)head[j] - base;
+    unlink_blk(off, j);
+    while (j > k) {
+        j--;
+        push(off + BLK(j), j);
+        STAT_INC(splits);
+    }
+    ORD(off) = k;
+    return (long)off;
+}
+
+/* grow - 차수 k 이상의 가용 블록이 생길 때까지 힙 끝에 정렬된 블록을 붙인다.
+ * 붙인 블록은 아래 버디와 합쳐지므로 힙은 필요한 만큼만 늘어난다. */
+static int grow(int k)
+{
+    size_t old;
+    int j;
+
+    while ((nonempty >> k) == 0) {
+        j = top ? __builtin_ctzl(top) : k;
+        if (j > k)
+            j = k;
+        if (top + BLK(j) > BLK(MAX_ORDER) || BLK(j) > INT_MAX ||
+            mem_sbrk((int)BLK(j)) == (void *)-1)
+            return -1;
+        STAT_INC(extends);
+        old = top;
+        top += BLK(j);
+        free_block(old, j);
+    }
+    return 0;
+}
+
+/* order - size 바이트가 들어가는 가장 작은 차수 */
+static int order(size_t size)
+{
+    if (size <= BLK(MIN_ORDER))
+        return MIN_ORDER;
+    return 64 - __builtin_clzl(size - 1);
+}
+
+/* mm_init - 메타데이터는 처음 한 번 잡고, 다음부터는 쓴 부분만 지운다 */
+int mm_init(void)
+{
+    size_t pad;
+    char *p;
+    int k;
+
+#ifdef MM_STATS
+    memset(&stats, 0, sizeof(stats));
+#endif
+    if (ord == NULL) {
+        meta_size = BLK(MAX_ORDER - MIN_ORDER);
+        for (k = MIN_ORDER; k <= MAX_ORDER; k++)
+            meta_size += (BLK(MAX_ORDER - k) + 63) / 64 * sizeof(uint64_t);
+        p = mmap(NULL, meta_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            return -1;
+        ord = (unsigned char *)p;
+        p += BLK(MAX_ORDER - MIN_ORDER);
+        for (k = MIN_ORDER; k <= MAX_ORDER; k++) {
+            fmap[k] = (uint64_t *)p;
+            p += (BLK(MAX_ORDER - k) + 63) / 64 * sizeof(uint64_t);
+        }
+    }
+    else {
+        memset(ord, 0, (top >> MIN_ORDER) + 1);
+        for (k = MIN_ORDER; k <= MAX_ORDER; k++)
+            memset(fmap[k], 0, ((top >> k) / 64 + 1) * sizeof(uint64_t));
+    }
+    memset(head, 0, sizeof(head));
+    nonempty = 0;
+    top = 0;
+
+    /* 힙 시작을 16바이트 경계에 맞춘다 */
+    if ((base = mem_sbrk(0)) == (void *)-1)
+        return -1;
+    pad = -(uintptr_t)base & (BLK(MIN_ORDER) - 1);
+    if (pad != 0) {
+        if (mem_sbrk((int)pad) == (void *)-1)
+            return -1;
+        base += pad;
+    }
+    return 0;
+}
+
+/* mm_malloc */
+void *mm_malloc(size_t size)
+{
+    long off;
+    int k;
+
+    if (size == 0 || (k = order(size)) > MAX_ORDER)
+        return NULL;
+    if ((off = take(k)) < 0) {
+        if (grow(k) < 0)
+            return NULL;
+        off = take(k);
+    }
+    return base + off;
+}
+
+/* mm_free */
+void mm_free(void *ptr)
+{
+    size_t off;
+
+    if (ptr == NULL)
+        return;
+    off = (char *)ptr - base;
+    free_block(off, ORD(off));
+}
+
+/* mm_memalign - 2^k 블록은 힙 시작 기준으로 2^k 정렬이므로 크기만 맞추면 된다.
+ * 힙 시작보다 더 큰 정렬은 보장할 수 없어 NULL */
+void *mm_memalign(size_t align, size_t size)
+{
+    char *p;
+
+    if (size == 0)
+        return NULL;
+    if ((p = mm_malloc(size > align ? size : align)) == NULL)
+        return NULL;
+    if ((uintptr_t)p & (align - 1)) {
+        mm_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+/* mm_realloc - 줄어들면 위쪽 절반들을 돌려주고, 커질 때는 위쪽 버디들이
+ * 가용이거나 힙 끝 너머면 제자리에서 합친다. 아니면 옮긴다. */
+void *mm_realloc(void *ptr, size_t size)
+{
+    size_t off, b, end, copySize;
+    int k, nk, j;
+    void *newptr;
+
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+
+    off = (char *)ptr - base;
+    k = ORD(off);
+    if ((nk = order(size)) > MAX_ORDER)
+        return NULL;
+
+    /* 줄어듦 */
+    if (nk <= k) {
+        while (k > nk) {
+            k--;
+            free_block(off + BLK(k), k);
+        }
+        ORD(off) = k;
+        STAT_INC(realloc_inplace);
+        return ptr;
+    }
+
+    /* 제자리: 블록이 매 단계 아래 버디이고 위 버디가 가용이거나 힙 끝 너머 */
+    for (j = k; j < nk; j++) {
+        b = off + BLK(j);
+        if ((off & BLK(j)) || (b < top && !is_free(b, j)))
+            break;
+    }
+    end = off + BLK(nk);
+    if (j == nk && end <= BLK(MAX_ORDER) && (end <= top || end - top <= INT_MAX)) {
+        if (end > top) {
+            if (mem_sbrk((int)(end - top)) == (void *)-1)
+                return NULL;
+            STAT_INC(extends);
+        }
+        for (j = k; j < nk; j++) {
+            b = off + BLK(j);
+            if (b < top)
+                unlink_blk(b, j);
+        }
+        if (end > top)
+            top = end;
+        ORD(off) = nk;
+        STAT_INC(realloc_inplace);
+        return ptr;
+    }
+
+    /* 옮김 */
+    if ((newptr = mm_malloc(size)) == NULL)
+        return NULL;
+    copySize = BLK(k) < size ? BLK(k) : size;
+    memcpy(newptr, ptr, copySize);
+    STAT_INC(realloc_copy);
+    STAT_ADD(bytes_copied, copySize);
+    mm_free(ptr);
+    return newptr;
+}
+
+/* mm_usable_size */
+size_t mm_usable_size(void *ptr)
+{
+    return BLK(ORD((size_t)((char *)ptr - base)));
+}
+
+/* mm_block_size - size 바이트 요청이 차지하는 블록 크기 */
+size_t mm_block_size(size_t size)
+{
+    return BLK(order(size));
+}
+
+/* mm_freeinfo - 가용 블록 수, 총 바이트, 가장 큰 블록 */
+void mm_freeinfo(size_t *nfree, size_t *free_bytes, size_t *largest)
+{
+    free_blk *b;
+    int k;
+
+    *nfree = *free_bytes = *largest = 0;
+    for (k = MIN_ORDER; k <= MAX_ORDER; k++)
+        for (b = head[k]; b != NULL; b = b->next) {
+            (*nfree)++;
+            *free_bytes += BLK(k);
+            *largest = BLK(k);
+        }
+}
+
+/* mm_heap_walk */
+void mm_heap_walk(mm_walk_fn fn, void *arg)
+{
+    size_t off;
+    int k;
+
+    for (off = 0; off < top; off += BLK(k)) {
+        k = ORD(off);
+        fn(base + off, base + off, BLK(k), !is_free(off, k), arg);  /* 헤더가 없다 */
+    }
+}
+
+/* mm_set_params - 버디 할당기는 조정할 파라미터가 없다 */
+int mm_set_params(const mm_params_t *p)
+{
+    return -1;
+}
+
+/* mm_get_params */
+void mm_get_params(mm_params_t *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+/* mm_sync - 미뤄 두는 일이 없다 */
+void mm_sync(void)
+{
+}
+
+/* mm_get_stats */
+int mm_get_stats(mm_stats_t *st)
+{
+#ifdef MM_STATS
+    *st = stats;
+    return 1;
+#else
+    memset(st, 0, sizeof(*st));
+    return 0;
+#endif
+}
@@ -15,49 +15,265 @@ team_t team = {
 };
 
 /* 매크로 */
+#ifdef MM_COMPACT
+#define WSIZE 4   /* 헤더/푸터 워드 */
+#else
 #define WSIZE 8
-#define DSIZE 16
-#define CHUNKSIZE (1 << 13) 
+#endif
+#define DSIZE 16  /* 정렬 */
+#define OVERHEAD (2 * WSIZE)  /* 헤더 + 푸터 */
+#define MIN_FREE (4 * WSIZE)  /* 가용 블록 최소 크기: 헤더, pred, succ, 푸터 */
+#define INIT_SIZE 64  /* 처음 힙: 패딩, 프롤로그, 첫 가용 블록, 에필로그 (두 배치 모두 같게) */
+
+/* 조정 가능한 파라미터의 기본값 - mdriver -T가 만든 헤더로 바꿀 수 있다
+ * (make MM_TUNED=mm_tuned.h). 실행 중에는 mm_set_params로 바꾼다. */
+#ifndef MM_CHUNKSIZE
+#define MM_CHUNKSIZE (1 << 13)
+#endif
+#ifndef MM_MIN_SPLIT
+#ifdef MM_COMPACT
+#define MM_MIN_SPLIT 48   /* 32면 16~32바이트 조각이 리스트에 쌓여 find_fit이 느려진다 */
+#else
+#define MM_MIN_SPLIT 32   /* 너무 작게 쪼개지 않게 이 이상만 split */
+#endif
+#endif
+#ifndef MM_MIN_BLOCK
+#define MM_MIN_BLOCK MIN_FREE
+#endif
+#ifndef MM_ROUND
+#define MM_ROUND DSIZE
+#endif
+#ifndef MM_TAIL_MIN
+#define MM_TAIL_MIN 128   /* 0이면 항상 가용 블록 앞쪽에 할당 */
+#endif
+#ifndef MM_PREFAULT
+#ifdef MM_BGTHREAD
+#define MM_PREFAULT (4 * MM_CHUNKSIZE)  /* 힙 끝 너머 미리 fault 해 둘 크기 (스레드가) */
+#else
+#define MM_PREFAULT 0     /* 호출 안에서 한꺼번에 fault 하면 그 호출이 길어진다 */
+#endif
+#endif
+#ifndef MM_LOW_WATER
+#define MM_LOW_WATER 0    /* 힙 끝 가용 블록이 이보다 작아지면 미리 늘린다 (MM_BGTHREAD) */
+#endif
+
+static mm_params_t params = {MM_CHUNKSIZE, MM_MIN_SPLIT, MM_MIN_BLOCK, MM_ROUND,
+                             MM_TAIL_MIN, MM_PREFAULT, MM_LOW_WATER};
+
+/* 이 크기 이상인 malloc은 가용 블록 뒤쪽에서 잘라 낸다 */
+#define TAIL_FIT(asize) (params.tail_min != 0 && (asize) >= params.tail_min)
+
+/* 크기 클래스 - sizeclass가 트레이스에서 만든 표 (make MM_CLASSES=mm_classes.h)
+ * 표의 최대 크기 이하 요청은 그 위의 가장 작은 클래스로 올려서 블록 크기를 정한다 */
+#ifdef MM_CLASSES
+#include MM_CLASSES
+#endif
+
+#define CHUNKSIZE (params.chunksize)
+#define MIN_SPLIT (params.min_split)
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
 #define GET(p) (*(unsigned int *)(p))
 #define PUT(p, val) (*(unsigned int *)(p) = (val))
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define HDRP(bp) ((char *)(bp) - WSIZE)
-#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - OVERHEAD)
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
-#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DSIZE))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - OVERHEAD))  /* 앞이 가용일 때만 */
+#define PREV_ALLOC(bp) GET_ALLOC((char *)(bp) - OVERHEAD)
 
-#define GET_SUCC(bp) (*(void **)((char *)(bp) + WSIZE))
+#ifdef MM_COMPACT
+/* 작은 블록 배치 (make MM_COMPACT=1) - 헤더/푸터가 4바이트, 가용 리스트 링크는
+ * mem_heap_lo()부터의 거리(DSIZE 단위)를 uint32로 적는다 (0이 NULL, 힙 64GB까지).
+ * 가용 블록 최소 크기가 16바이트로 줄어 8바이트 이하 요청은 16바이트 블록에 들어간다.
+ * 할당 블록의 푸터 자리에는 크기 대신 HDR_AUX를 둔다 (최하위 비트가 1이라 뒤 블록이
+ * 할당 비트는 그대로 읽는다). 크기는 쓰지 못하니 PREV_BLKP는 앞이 가용일 때만 쓴다. */
+#define LINK_OFF(p) ((p) ? (unsigned int)(((char *)(p) - (char *)mem_heap_lo()) / DSIZE) : 0)
+#define LINK_PTR(v) ((v) ? (void *)((char *)mem_heap_lo() + (size_t)(v) * DSIZE) : NULL)
+#define GET_PRED(bp) LINK_PTR(*(unsigned int *)(bp))
+#define GET_SUCC(bp) LINK_PTR(*((unsigned int *)(bp) + 1))
+#define SET_PRED(bp, p) (*(unsigned int *)(bp) = LINK_OFF(p))
+#define SET_SUCC(bp, p) (*((unsigned int *)(bp) + 1) = LINK_OFF(p))
+
+#define HDR_AUX(bp) (*(unsigned int *)FTRP(bp))
+#else
 #define GET_PRED(bp) (*(void **)(bp))
+#define GET_SUCC(bp) (*(void **)((char *)(bp) + WSIZE))
+#define SET_PRED(bp, p) (GET_PRED(bp) = (p))
+#define SET_SUCC(bp, p) (GET_SUCC(bp) = (p))
+
+/* 헤더 워드(8바이트)에서 크기/할당 비트가 쓰지 않는 상위 4바이트 */
+#define HDR_AUX(bp) (*(unsigned int *)((char *)(bp) - WSIZE + 4))
+#endif
+
+/* realloc 성장 추적 - 할당 블록의 HDR_AUX에
+ * 마지막 요청 블록 크기(DSIZE 단위) << 4 | 연속으로 커진 횟수(최대 7) << 1 | 1 */
+#define GROW_PACK(asize, n) ((unsigned int)((asize) / DSIZE) << 4 | (n) << 1 | 1)
+#define GROW_SIZE(bp) ((size_t)(HDR_AUX(bp) >> 4) * DSIZE)
+#define GROW_COUNT(bp) (HDR_AUX(bp) >> 1 & 0x7)
+#define GROW_MAX 7
+#define GROW_CHAIN 2  /* 이만큼 연속으로 커지면 성장 체인으로 본다 */
+
+/* 이보다 큰 블록을 옮길 때는 페이지 안 위치가 같은 곳에 두고 페이지째 옮긴다 */
+#define REMAP_MIN (1 << 20)
+
+/* 통계 카운터 - MM_STATS 없이 빌드하면 코드가 전부 사라진다 */
+#ifdef MM_STATS
+static mm_stats_t stats;
+#define STAT_INC(field) (stats.field++)
+#define STAT_ADD(field, n) (stats.field += (n))
+#else
+#define STAT_INC(field)
+#define STAT_ADD(field, n) ((void)(n))
+#endif
 
 /* 전역변수 */
 static char *heap_listp;
+static char *fault_end;  /* 여기까지 미리 fault 해 두었다 */
+
+#ifdef MM_SIDE_INDEX
+/* 가용 블록 보조 인덱스 (make MM_SIDE_INDEX=1, AVX2는 MM_SIDE_INDEX=avx2)
+ * 가용 블록의 크기와 위치(힙 시작부터 DSIZE 단위)를 각각 uint32 배열에 모아 둔다.
+ * find_fit은 리스트를 따라가는 대신 이 배열을 SIMD로 훑고, 블록 헤더 워드의
+ * 비어 있는 상위 4바이트(MM_COMPACT면 payload 첫 워드)에 배열 인덱스를 적어 두어
+ * 제거는 O(1)이다.
+ * 배열은 malloc을 쓸 수 없는 libmm.so에서도 돌도록 mmap으로 잡는다. */
+#include <stdint.h>
+#include <sys/mman.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SIDE_INIT 4096
+#ifdef MM_COMPACT
+#define SIDE_IDX(bp) (*(unsigned int *)(bp))  /* 링크를 안 쓰므로 그 자리에 */
+#else
+#define SIDE_IDX(bp) HDR_AUX(bp)
+#endif
+#define SIDE_BP(i) ((char *)mem_heap_lo() + (size_t)side_off[i] * DSIZE)
+
+static uint32_t *side_size;  /* 가용 블록 크기 */
+static uint32_t *side_off;   /* 가용 블록 위치 */
+static size_t side_n, side_max;
+
+static int side_reserve(size_t n);
+#endif
+
+#ifdef MM_BGTHREAD
+/* 유지보수 스레드 (make MM_BGTHREAD=1)
+ * mm_free는 블록을 lock-free 스택(defer_head, 링크는 payload 첫 워드)에 CAS로 넣고
+ * 바로 돌아간다. 블록은 할당 상태 그대로라 아무도 병합하지 않는다. 스레드는
+ * 주기적으로(또는 DEFER_WAKE개마다 깨워지면) 스택을 통째로 가져가 병합과
+ * 주소순서 삽입을 하고, 힙 끝 가용 블록이 크면 페이지를 돌려주고(trim), 힙 끝
+ * 너머를 미리 fault 해 둔다. 리스트와 헤더는 heap_lock을 잡고만 바꾼다:
+ * malloc/realloc과 스레드의 일 한 묶음. malloc은 맞는 블록이 없을 때만 남은
+ * free를 직접 처리한다.
+ * 실험용이다: malloc도 여전히 heap_lock을 잡고, CPU 하나에서 재 보니 free 중앙값은
+ * 줄었지만 꼬리 지연은 늘었다 (p99.9 11us -> 61us, README). */
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define DEFER_WAKE 64           /* free가 이만큼 쌓일 때마다 스레드를 깨운다 */
+#define DEFER_MAX 4096          /* 이보다 쌓이면 malloc이 직접 처리 (스레드가 밀릴 때) */
+#define BG_INTERVAL 1000000     /* 스레드가 스스로 깨는 주기 (ns) */
+#define TRIM_KEEP MAX(4 * CHUNKSIZE, params.low_water)  /* 힙 끝 가용 블록에서 이만큼은 남긴다 */
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *defer_head;        /* 미룬 free 스택 */
+static long defer_n;            /* 스택의 블록 수 */
+static sem_t bg_sem;
+static pid_t bg_pid;            /* 스레드를 띄운 프로세스 (fork한 자식은 다시 띄운다) */
+static int bg_idle;             /* mm_sync 뒤 다음 mm_init까지 스레드는 힙을 안 건드리고
+                                   mm_free는 미루지 않는다 */
+static char *heap_top;          /* 에필로그 바로 뒤 (드라이버가 brk를 되돌려도 그대로) */
+static char *trim_lo, *trim_hi; /* 마지막으로 돌려준 페이지 */
+static unsigned long heap_gen;  /* init_heap마다 1 증가 (스레드가 락 밖에서 한 일이 옛 힙 것인지) */
+
+static int bg_start(void);
+static long drain_deferred(void);
+static void *drain_until(size_t asize);
+#define LOCK() pthread_mutex_lock(&heap_lock)
+#define UNLOCK() pthread_mutex_unlock(&heap_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
 
 /* 함수 선언 */
+static int init_heap(void);
+static void *do_malloc(size_t size);
+static void *do_free(void *bp);
+static void *do_realloc(void *ptr, size_t size);
 static void *extend_heap(size_t words);
+#ifndef MM_BGTHREAD
+static void prefault_heap(char *lo, char *top);
+#endif
 static void *coalesce(void *bp);
 static void *find_fit(size_t asize);
-static void place(void *bp, size_t asize);
+static void *place(void *bp, size_t asize, int tail);
+static void *place_at_top(size_t asize, void *like);
 static void add_free_block(void *bp);
 static void splice_free_block(void *bp);
 
 /* mm_init */
 int mm_init(void)
 {
-    if ((heap_listp = mem_sbrk(8 * WSIZE)) == (void *)-1)
+    int r;
+
+#ifdef MM_BGTHREAD
+    if (bg_start() < 0)
+        return -1;
+#endif
+    LOCK();
+    r = init_heap();
+    UNLOCK();
+    return r;
+}
+
+/* init_heap - 빈 힙에 프롤로그/에필로그와 첫 가용 블록을 만든다 */
+static int init_heap(void)
+{
+#ifdef MM_BGTHREAD
+    defer_head = NULL;
+    defer_n = 0;
+    __atomic_store_n(&bg_idle, 0, __ATOMIC_RELAXED);
+    trim_lo = trim_hi = NULL;
+    heap_gen++;
+#endif
+    fault_end = NULL;
+#ifdef MM_STATS
+    memset(&stats, 0, sizeof(stats));
+#endif
+#ifdef MM_SIDE_INDEX
+    side_n = 0;
+    if (side_reserve(CHUNKSIZE / MIN_FREE + 2) < 0)
+        return -1;
+#endif
+    if ((heap_listp = mem_sbrk(INIT_SIZE)) == (void *)-1)
         return -1;
     PUT(heap_listp, 0);
     PUT(heap_listp + (1 * WSIZE), PACK(2 * WSIZE, 1));
     PUT(heap_listp + (2 * WSIZE), PACK(2 * WSIZE, 1));
-    PUT(heap_listp + (3 * WSIZE), PACK(4 * WSIZE, 0));
-    PUT(heap_listp + (4 * WSIZE), 0);
-    PUT(heap_listp + (5 * WSIZE), 0);
-    PUT(heap_listp + (6 * WSIZE), PACK(4 * WSIZE, 0));
-    PUT(heap_listp + (7 * WSIZE), PACK(0, 1));
+    PUT(heap_listp + (3 * WSIZE), PACK(INIT_SIZE - 4 * WSIZE, 0));
+    PUT(heap_listp + INIT_SIZE - 2 * WSIZE, PACK(INIT_SIZE - 4 * WSIZE, 0));
+    PUT(heap_listp + INIT_SIZE - WSIZE, PACK(0, 1));
     heap_listp += (4 * WSIZE);
+#ifdef MM_BGTHREAD
+    heap_top = heap_listp - 4 * WSIZE + INIT_SIZE;
+#endif
+    /* PUT은 하위 4바이트만 쓰므로 포인터는 통째로 지운다 (힙에 다른 할당기가 남긴 값) */
+    SET_PRED(heap_listp, NULL);
+    SET_SUCC(heap_listp, NULL);
+#ifdef MM_SIDE_INDEX
+    add_free_block(heap_listp);
+#endif
 
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
         return -1;
@@ -70,16 +286,44 @@ static void *extend_heap(size_t words)
     char *bp;
     size_t size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
 
+#ifdef MM_SIDE_INDEX
+    /* 가용 블록은 최소 MIN_FREE이므로 힙 크기로 필요한 칸 수가 정해진다 */
+    if (side_reserve((mem_heapsize() + size) / MIN_FREE + 1) < 0)
+        return NULL;
+#endif
     if ((long)(bp = mem_sbrk(size)) == -1)
         return NULL;
+    STAT_INC(extends);
+#ifndef MM_BGTHREAD
+    prefault_heap(bp, bp + size);  /* 스레드가 있으면 스레드가 한다 */
+#endif
 
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+#ifdef MM_BGTHREAD
+    heap_top = NEXT_BLKP(bp);
+#endif
 
     return coalesce(bp);
 }
 
+#ifndef MM_BGTHREAD
+/* prefault_heap - lo부터 힙 끝(top) 너머 params.prefault 바이트까지 미리 fault 해 둔다.
+ * 해 둔 여유가 절반 아래로 줄었을 때만 한 번에 채워 시스템 콜을 줄인다. */
+static void prefault_heap(char *lo, char *top)
+{
+    if (params.prefault == 0 || fault_end >= top + params.prefault / 2)
+        return;
+    if (lo < fault_end)
+        lo = fault_end;
+    mem_prefault(lo, top + params.prefault - lo);
+    fault_end = top + params.prefault;
+    mem_touch(fault_end);
+}
+#endif
+
+#ifndef MM_SIDE_INDEX
 /* add_free_block - 주소순서 삽입 */
 static void add_free_block(void *bp)
 {
@@ -89,50 +333,58 @@ static void add_free_block(void *bp)
     while (cur != NULL && cur < bp) {
         prev = cur;
         cur = GET_SUCC(cur);
+        STAT_INC(insert_steps);
     }
 
     if (prev != NULL)
-        GET_SUCC(prev) = bp;
+        SET_SUCC(prev, bp);
     else
         heap_listp = bp;
 
     if (cur != NULL)
-        GET_PRED(cur) = bp;
+        SET_PRED(cur, bp);
 
-    GET_PRED(bp) = prev;
-    GET_SUCC(bp) = cur;
+    SET_PRED(bp, prev);
+    SET_SUCC(bp, cur);
 }
 
 /* splice_free_block */
 static void splice_free_block(void *bp)
 {
-    if (GET_PRED(bp))
-        GET_SUCC(GET_PRED(bp)) = GET_SUCC(bp);
+    void *pred = GET_PRED(bp), *succ = GET_SUCC(bp);
+
+    if (pred)
+        SET_SUCC(pred, succ);
     else
-        heap_listp = GET_SUCC(bp);
+        heap_listp = succ;
 
-    if (GET_SUCC(bp))
-        GET_PRED(GET_SUCC(bp)) = GET_PRED(bp);
+    if (succ)
+        SET_PRED(succ, pred);
 }
 
+#endif /* !MM_SIDE_INDEX */
+
 /* coalesce */
 static void *coalesce(void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = PREV_ALLOC(bp);
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
     if (prev_alloc && next_alloc) {
+        STAT_INC(coalesce[0]);
         add_free_block(bp);
         return bp;
     }
     else if (prev_alloc && !next_alloc) {
+        STAT_INC(coalesce[1]);
         splice_free_block(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
     }
     else if (!prev_alloc && next_alloc) {
+        STAT_INC(coalesce[2]);
         splice_free_block(PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         PUT(FTRP(bp), PACK(size, 0));
@@ -140,6 +392,7 @@ static void *coalesce(void *bp)
         bp = PREV_BLKP(bp);
     }
     else {
+        STAT_INC(coalesce[3]);
         splice_free_block(PREV_BLKP(bp));
         splice_free_block(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
@@ -151,6 +404,7 @@ static void *coalesce(void *bp)
     return bp;
 }
 
+#ifndef MM_SIDE_INDEX
 /* find_fit - Best Fit */
 static void *find_fit(size_t asize)
 {
@@ -160,6 +414,7 @@ static void *find_fit(size_t asize)
 
     while (bp != NULL) {
         size_t bsize = GET_SIZE(HDRP(bp));
+        STAT_INC(fit_steps);
         if (!GET_ALLOC(HDRP(bp)) && bsize >= asize) {
             if (bsize < best_size) {
                 best = bp;
@@ -171,15 +426,156 @@ static void *find_fit(size_t asize)
     return best;
 }
 
-/* place */
-#define MIN_SPLIT 32  // 🔥 너무 작게 쪼개지 않게 32바이트 이상만 split
+#else /* MM_SIDE_INDEX */
+
+/* side_reserve - 인덱스 배열을 n칸 이상으로 늘림 */
+static int side_reserve(size_t n)
+{
+    size_t max = side_max ? side_max : SIDE_INIT;
+    uint32_t *p;
+
+    if (n <= side_max)
+        return 0;
+    while (max < n)
+        max *= 2;
+    p = mmap(NULL, 2 * max * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    if (side_max) {
+        memcpy(p, side_size, side_n * sizeof(uint32_t));
+        memcpy(p + max, side_off, side_n * sizeof(uint32_t));
+        munmap(side_size, 2 * side_max * sizeof(uint32_t));
+    }
+    side_size = p;
+    side_off = p + max;
+    side_max = max;
+    return 0;
+}
 
-static void place(void *bp, size_t asize)
+/* add_free_block - 인덱스 끝에 추가 (칸은 extend_heap이 미리 확보) */
+static void add_free_block(void *bp)
+{
+    SIDE_IDX(bp) = side_n;
+    side_size[side_n] = GET_SIZE(HDRP(bp));
+    side_off[side_n] = ((char *)bp - (char *)mem_heap_lo()) / DSIZE;
+    side_n++;
+}
+
+/* splice_free_block - 마지막 칸을 빈자리로 옮겨 채움 */
+static void splice_free_block(void *bp)
+{
+    unsigned int i = SIDE_IDX(bp);
+
+    side_n--;
+    if (i != side_n) {
+        side_size[i] = side_size[side_n];
+        side_off[i] = side_off[side_n];
+        SIDE_IDX(SIDE_BP(i)) = i;
+    }
+}
+
+/* find_fit - Best Fit, 리스트 버전과 같은 블록을 고른다:
+ * asize 이상인 것 중 (크기, 주소)가 가장 작은 블록.
+ * SIMD에는 부호 없는 32비트 비교가 없어 최상위 비트를 뒤집어 부호 있는 비교로 한다. */
+static void *find_fit(size_t asize)
+{
+    uint32_t bs = UINT32_MAX, bo = UINT32_MAX;
+    size_t i = 0;
+    int k;
+
+    if (asize > UINT32_MAX)
+        return NULL;
+    STAT_ADD(fit_steps, side_n);
+
+#ifdef __AVX2__
+    {
+        const __m256i bias = _mm256_set1_epi32((int)0x80000000);
+        const __m256i need = _mm256_set1_epi32((int)((asize - 1) ^ 0x80000000));
+        __m256i vs = _mm256_set1_epi32(0x7fffffff), vo = vs;
+        uint32_t ls[8], lo[8];
+
+        for (; i + 8 <= side_n; i += 8) {
+            __m256i s = _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(side_size + i)), bias);
+            __m256i o = _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(side_off + i)), bias);
+            __m256i better = _mm256_or_si256(_mm256_cmpgt_epi32(vs, s),
+                             _mm256_and_si256(_mm256_cmpeq_epi32(vs, s), _mm256_cmpgt_epi32(vo, o)));
+            __m256i take = _mm256_and_si256(_mm256_cmpgt_epi32(s, need), better);
+            vs = _mm256_blendv_epi8(vs, s, take);
+            vo = _mm256_blendv_epi8(vo, o, take);
+        }
+        _mm256_storeu_si256((__m256i *)ls, _mm256_xor_si256(vs, bias));
+        _mm256_storeu_si256((__m256i *)lo, _mm256_xor_si256(vo, bias));
+        for (k = 0; k < 8; k++)
+            if (ls[k] < bs || (ls[k] == bs && lo[k] < bo)) {
+                bs = ls[k];
+                bo = lo[k];
+            }
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128i bias = _mm_set1_epi32((int)0x80000000);
+        const __m128i need = _mm_set1_epi32((int)((asize - 1) ^ 0x80000000));
+        __m128i vs = _mm_set1_epi32(0x7fffffff), vo = vs;
+        uint32_t ls[4], lo[4];
+
+        for (; i + 4 <= side_n; i += 4) {
+            __m128i s = _mm_xor_si128(_mm_loadu_si128((__m128i *)(side_size + i)), bias);
+            __m128i o = _mm_xor_si128(_mm_loadu_si128((__m128i *)(side_off + i)), bias);
+            __m128i better = _mm_or_si128(_mm_cmpgt_epi32(vs, s),
+                             _mm_and_si128(_mm_cmpeq_epi32(vs, s), _mm_cmpgt_epi32(vo, o)));
+            __m128i take = _mm_and_si128(_mm_cmpgt_epi32(s, need), better);
+            vs = _mm_or_si128(_mm_and_si128(take, s), _mm_andnot_si128(take, vs));
+            vo = _mm_or_si128(_mm_and_si128(take, o), _mm_andnot_si128(take, vo));
+        }
+        _mm_storeu_si128((__m128i *)ls, _mm_xor_si128(vs, bias));
+        _mm_storeu_si128((__m128i *)lo, _mm_xor_si128(vo, bias));
+        for (k = 0; k < 4; k++)
+            if (ls[k] < bs || (ls[k] == bs && lo[k] < bo)) {
+                bs = ls[k];
+                bo = lo[k];
+            }
+    }
+#endif
+    /* 나머지 (SIMD가 없으면 전부) */
+    for (; i < side_n; i++)
+        if (side_size[i] >= asize &&
+            (side_size[i] < bs || (side_size[i] == bs && side_off[i] < bo))) {
+            bs = side_size[i];
+            bo = side_off[i];
+        }
+
+    if (bs == UINT32_MAX)
+        return NULL;
+    return (char *)mem_heap_lo() + (size_t)bo * DSIZE;
+}
+#endif /* MM_SIDE_INDEX */
+
+/* place - 가용 블록 bp에 asize를 할당하고 할당된 블록을 돌려준다
+ * tail이면 뒤쪽을 할당하고 앞부분을 가용 블록으로 남긴다. 앞부분은 주소가
+ * 그대로라 리스트에서 뺄 필요가 없다. 큰 블록과 작은 블록이 가용 블록 양 끝에서
+ * 따로 모이므로, 큰 블록들이 풀리면 서로 합쳐진다. */
+static void *place(void *bp, size_t asize, int tail)
 {
     size_t csize = GET_SIZE(HDRP(bp));
-    splice_free_block(bp);  // free list에서 제거
 
+    if (tail && csize - asize >= MIN_SPLIT) {
+        STAT_INC(splits);
+        PUT(HDRP(bp), PACK(csize - asize, 0));
+        PUT(FTRP(bp), PACK(csize - asize, 0));
+#ifdef MM_SIDE_INDEX
+        side_size[SIDE_IDX(bp)] = csize - asize;
+#endif
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        HDR_AUX(bp) = GROW_PACK(asize, 0);
+        return bp;
+    }
+
+    splice_free_block(bp);  // free list에서 제거
     if ((csize - asize) >= MIN_SPLIT) {
+        STAT_INC(splits);
         // [1] 앞부분은 할당 처리
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
@@ -196,11 +592,61 @@ static void place(void *bp, size_t asize)
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
     }
-} 
+    HDR_AUX(bp) = GROW_PACK(asize, 0);
+    return bp;
+}
+
+/* place_at_top - 힙 맨 끝에 asize 블록을 만든다 (계속 커지는 realloc 블록용)
+ * 마지막 블록이 가용이면 모자란 만큼만 힙을 늘린다.
+ * like가 있으면 블록이 페이지 안에서 like와 같은 위치에 오도록 앞을 비운다
+ * (mem_remap이 페이지째 옮길 수 있게). */
+static void *place_at_top(size_t asize, void *like)
+{
+    char *end = (char *)mem_heap_hi() + 1;  /* 에필로그 바로 뒤 */
+    size_t have = PREV_ALLOC(end) ? 0 : GET_SIZE(end - OVERHEAD);  /* 끝 가용 블록 */
+    char *last = end - have;
+    char *bp = last;  /* 새 블록이 시작할 곳 */
+    size_t page = mem_pagesize();
+    size_t pad = 0, total;
 
+    if (like != NULL) {
+        pad = ((char *)like - bp) & (page - 1);
+        if (pad != 0 && pad < MIN_SPLIT)
+            pad += page;
+    }
+    if (have >= pad + asize)
+        bp = last;
+    else if ((bp = extend_heap((pad + asize - have) / WSIZE)) == NULL)
+        return NULL;
+
+    /* 앞을 비운 만큼은 가용 블록으로 남긴다 */
+    if (pad != 0) {
+        total = GET_SIZE(HDRP(bp));
+        splice_free_block(bp);
+        PUT(HDRP(bp), PACK(pad, 0));
+        PUT(FTRP(bp), PACK(pad, 0));
+        add_free_block(bp);
+        bp += pad;
+        PUT(HDRP(bp), PACK(total - pad, 0));
+        PUT(FTRP(bp), PACK(total - pad, 0));
+        add_free_block(bp);
+    }
+    return place(bp, asize, 0);
+}
 
 /* mm_malloc */
 void *mm_malloc(size_t size)
+{
+    void *bp;
+
+    LOCK();
+    bp = do_malloc(size);
+    UNLOCK();
+    return bp;
+}
+
+/* do_malloc */
+static void *do_malloc(size_t size)
 {
     size_t asize;
     size_t extendsize;
@@ -209,66 +655,526 @@ void *mm_malloc(size_t size)
     if (size == 0)
         return NULL;
 
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+    asize = mm_block_size(size);
 
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        return bp;
-    }
+#ifdef MM_BGTHREAD
+    if (defer_n > DEFER_MAX)
+        drain_deferred();
+#endif
+    if ((bp = find_fit(asize)) != NULL)
+        return place(bp, asize, TAIL_FIT(asize));
+#ifdef MM_BGTHREAD
+    /* 스레드가 아직 처리하지 못한 free를 asize가 들어갈 블록이 생길 때까지만 직접 처리한다 */
+    if ((bp = drain_until(asize)) != NULL)
+        return place(bp, asize, TAIL_FIT(asize));
+#endif
 
     extendsize = MAX(asize, CHUNKSIZE);
     if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
         return NULL;
-    place(bp, asize);
-    return bp;
+    return place(bp, asize, TAIL_FIT(asize));
 }
 
 /* mm_free */
 void mm_free(void *bp)
+{
+#ifdef MM_BGTHREAD
+    void *head;
+
+    /* 스레드가 쉬는 동안은 미뤄도 처리할 쪽이 없으니 바로 병합한다 */
+    if (__atomic_load_n(&bg_idle, __ATOMIC_RELAXED)) {
+        LOCK();
+        do_free(bp);
+        UNLOCK();
+        return;
+    }
+    head = __atomic_load_n(&defer_head, __ATOMIC_RELAXED);
+    do
+        *(void **)bp = head;
+    while (!__atomic_compare_exchange_n(&defer_head, &head, bp, 1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+    if (__atomic_add_fetch(&defer_n, 1, __ATOMIC_RELAXED) % DEFER_WAKE == 0)
+        sem_post(&bg_sem);
+#else
+    do_free(bp);
+#endif
+}
+
+/* do_free */
+static void *do_free(void *bp)
 {
     size_t size = GET_SIZE(HDRP(bp));
 
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    return coalesce(bp);
+}
+
+/* mm_memalign - align(2의 거듭제곱) 경계에 맞춘 블록 할당
+ * 여유분을 붙여 할당한 뒤, 정렬 지점 앞부분(>= MIN_FREE)은 가용 블록으로 되돌리고
+ * 뒤에 남는 부분도 MIN_SPLIT 이상이면 잘라서 반환한다.
+ * 여유분은 요청이 아니라 블록 크기(asize)에 붙인다: 크기 클래스나 큰 round는
+ * 요청을 여유분보다 더 올릴 수 있어, 앞을 잘라 낸 나머지에 asize가 안 들어갈 수 있다. */
+void *mm_memalign(size_t align, size_t size)
+{
+    char *bp, *p;
+    size_t csize, asize, lead;
+
+    if (align <= DSIZE)
+        return mm_malloc(size);
+    if (size == 0)
+        return NULL;
+
+    asize = mm_block_size(size);
+    LOCK();
+    /* 앞부분은 MIN_FREE + align 보다 짧으니 나머지는 asize 이상이다 */
+    if ((bp = do_malloc(asize - OVERHEAD + align + MIN_FREE)) == NULL) {
+        UNLOCK();
+        return NULL;
+    }
+
+    /* 앞부분이 가용 블록이 되려면 최소 MIN_FREE 필요 */
+    p = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+    if (p != bp && (size_t)(p - bp) < MIN_FREE)
+        p += align;
+
+    csize = GET_SIZE(HDRP(bp));
+    if (p != bp) {
+        lead = p - bp;
+        PUT(HDRP(p), PACK(csize - lead, 1));
+        PUT(FTRP(p), PACK(csize - lead, 1));
+        PUT(HDRP(bp), PACK(lead, 0));
+        PUT(FTRP(bp), PACK(lead, 0));
+        coalesce(bp);
+        csize -= lead;
+    }
+
+    /* 뒷부분 반환 */
+    if (csize >= asize + MIN_SPLIT) {
+        char *next_bp;
+
+        PUT(HDRP(p), PACK(asize, 1));
+        PUT(FTRP(p), PACK(asize, 1));
+        next_bp = NEXT_BLKP(p);
+        PUT(HDRP(next_bp), PACK(csize - asize, 0));
+        PUT(FTRP(next_bp), PACK(csize - asize, 0));
+        coalesce(next_bp);
+    }
+    HDR_AUX(p) = GROW_PACK(MIN(asize, csize), 0);
+    UNLOCK();
+    return p;
+}
+
+/* mm_block_size - size 바이트 요청에 쓰이는 블록 크기 (헤더/푸터 + 정렬) */
+size_t mm_block_size(size_t size)
+{
+    size_t asize;
+#ifdef MM_CLASSES
+    int lo = 0, hi = MM_NCLASSES - 1, mid;
+
+    if (size <= mm_class_size[hi]) {
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (mm_class_size[mid] < size)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        size = mm_class_size[lo];
+    }
+#endif
+    asize = params.round * ((size + OVERHEAD + params.round - 1) / params.round);
+
+    return MAX(asize, params.min_block);
+}
+
+/* mm_set_params - 파라미터 변경 (다음 요청부터 적용)
+ * 크기는 모두 DSIZE의 배수, 블록은 최소 MIN_FREE라야 한다. 틀리면 -1 */
+int mm_set_params(const mm_params_t *p)
+{
+    if (p->chunksize < 2 * DSIZE || p->chunksize % DSIZE != 0 ||
+        p->min_split < MIN_FREE || p->min_split % DSIZE != 0 ||
+        p->min_block < MIN_FREE || p->min_block % DSIZE != 0 ||
+        p->round < DSIZE || p->round % DSIZE != 0 || p->tail_min % DSIZE != 0)
+        return -1;
+    params = *p;
+    return 0;
+}
+
+/* mm_get_params */
+void mm_get_params(mm_params_t *p)
+{
+    *p = params;
+}
+
+/* mm_heap_walk - 첫 블록부터 에필로그까지 모든 블록에 fn 호출 (드라이버용)
+ * 첫 블록은 패딩/프롤로그 뒤 mem_heap_lo() + 4*WSIZE 에 있다. */
+void mm_heap_walk(mm_walk_fn fn, void *arg)
+{
+    char *bp;
+
+    LOCK();
+#ifdef MM_BGTHREAD
+    drain_deferred();
+#endif
+    for (bp = (char *)mem_heap_lo() + 4 * WSIZE; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        fn(HDRP(bp), bp, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)), arg);
+    UNLOCK();
+}
+
+/* mm_get_stats - 카운터 복사 (MM_STATS 빌드가 아니면 0 반환) */
+int mm_get_stats(mm_stats_t *st)
+{
+#ifdef MM_STATS
+    *st = stats;
+    return 1;
+#else
+    memset(st, 0, sizeof(*st));
+    return 0;
+#endif
 }
 
-/* mm_realloc - in-place 최적화 */
+/* mm_usable_size - 블록에서 실제로 쓸 수 있는 payload 바이트 수 */
+size_t mm_usable_size(void *ptr)
+{
+    return GET_SIZE(HDRP(ptr)) - OVERHEAD;
+}
+
+/* mm_freeinfo - 가용 블록 수, 가용 바이트 합, 최대 가용 블록 크기 (드라이버용) */
+void mm_freeinfo(size_t *nfree, size_t *free_bytes, size_t *largest)
+{
+    size_t size;
+#ifdef MM_SIDE_INDEX
+    size_t i;
+#else
+    void *bp;
+#endif
+
+    *nfree = *free_bytes = *largest = 0;
+    LOCK();
+#ifdef MM_BGTHREAD
+    drain_deferred();
+#endif
+#ifdef MM_SIDE_INDEX
+    for (i = 0; i < side_n; i++) {
+        size = side_size[i];
+#else
+    for (bp = heap_listp; bp != NULL; bp = GET_SUCC(bp)) {
+        size = GET_SIZE(HDRP(bp));
+#endif
+        (*nfree)++;
+        *free_bytes += size;
+        if (size > *largest)
+            *largest = size;
+    }
+    UNLOCK();
+}
+
+/* mm_realloc - in-place 최적화 + 성장 체인 처리
+ * 같은 블록이 연속으로 커지면(GROW_CHAIN번 이상) 성장 체인으로 보고
+ * - 힙 끝에 있으면 뒤 가용 블록을 전부 쥐고, 모자라면 그만큼만 힙을 늘려 키우고
+ * - 옆 가용 블록을 흡수할 때는 절반만큼 여유를 더 잡아 두고
+ * - 앞에 큰 가용 블록이 있으면 그쪽으로 당겨 옮겨 그 틈을 다시 쓰고
+ * - 옮겨야 하는데 맞는 가용 블록이 없으면 힙 끝으로 옮겨 다음부터 제자리에서 커지게 한다.
+ * 요청이 줄어들면 체인이 끝난 것으로 보고 남는 부분을 돌려준다. */
 void *mm_realloc(void *ptr, size_t size)
 {
+    void *p;
+
+    LOCK();
+    p = do_realloc(ptr, size);
+    UNLOCK();
+    return p;
+}
+
+/* do_realloc */
+static void *do_realloc(void *ptr, size_t size)
+{
+    size_t oldsize, asize, total, target, copySize, remapped, back;
+    unsigned int n;
+    int top;
+    char *next, *rest, *newptr, *prev;
+
     if (ptr == NULL)
-        return mm_malloc(size);
+        return do_malloc(size);
     if (size == 0) {
-        mm_free(ptr);
+        do_free(ptr);
         return NULL;
     }
 
-    size_t oldsize = GET_SIZE(HDRP(ptr));
-    size_t asize = (size <= DSIZE) ? (2 * DSIZE) : DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+    oldsize = GET_SIZE(HDRP(ptr));
+    asize = mm_block_size(size);
+    n = GROW_COUNT(ptr);
 
-    if (asize <= oldsize)
+    /* 줄어듦: 남는 뒷부분 반환 */
+    if (asize < GROW_SIZE(ptr)) {
+        if (oldsize - asize >= MIN_SPLIT) {
+            PUT(HDRP(ptr), PACK(asize, 1));
+            PUT(FTRP(ptr), PACK(asize, 1));
+            rest = NEXT_BLKP(ptr);
+            PUT(HDRP(rest), PACK(oldsize - asize, 0));
+            PUT(FTRP(rest), PACK(oldsize - asize, 0));
+            coalesce(rest);
+        }
+        HDR_AUX(ptr) = GROW_PACK(asize, 0);
+        STAT_INC(realloc_inplace);
+        return ptr;
+    }
+    if (asize > GROW_SIZE(ptr) && n < GROW_MAX)
+        n++;
+
+    /* 잡아 둔 여유 안에서 커짐 */
+    if (asize <= oldsize) {
+        HDR_AUX(ptr) = GROW_PACK(asize, n);
+        STAT_INC(realloc_inplace);
         return ptr;
+    }
+
+    /* 체인 앞의 가용 블록(back) - 블록의 1/4 이상이면 아래에서 앞으로 당겨 쓴다.
+     * 그보다 작은 틈을 먹으려고 블록을 통째로 옮기지는 않는다 */
+    back = 0;
+    if (n >= GROW_CHAIN && oldsize - OVERHEAD < REMAP_MIN && !PREV_ALLOC(ptr) &&
+        GET_SIZE(HDRP(PREV_BLKP(ptr))) >= oldsize / 4)
+        back = GET_SIZE(HDRP(PREV_BLKP(ptr)));
 
-    void *next = NEXT_BLKP(ptr);
-    if (!GET_ALLOC(HDRP(next)) && (oldsize + GET_SIZE(HDRP(next))) >= asize) {
+    /* 힙 끝 블록: 모자란 만큼만 힙을 늘리면 뒤에 가용 블록이 생긴다 (back만큼 덜) */
+    next = NEXT_BLKP(ptr);
+    top = GET_SIZE(HDRP(next)) == 0 ||
+          (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0);
+    if (top) {
+        total = oldsize + (GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next)));
+        /* 늘린 부분도 가용 블록이 되므로 최소 MIN_FREE (링크가 에필로그를 덮지 않게) */
+        if (total + back < asize &&
+            extend_heap(MAX(asize - total - back, MIN_FREE) / WSIZE) == NULL)
+            return NULL;
+        next = NEXT_BLKP(ptr);
+    }
+
+    /* 뒤 가용 블록 흡수. 체인이면 힙 끝에서는 전부, 중간에서는 절반만큼 여유를 두고
+     * 나머지는 잘라서 돌려준다 (뒤에 작은 블록이 붙으면 다시 옮겨야 하므로) */
+    if (!GET_ALLOC(HDRP(next)) && oldsize + GET_SIZE(HDRP(next)) >= asize) {
         splice_free_block(next);
-        size_t newsize = oldsize + GET_SIZE(HDRP(next));
-        PUT(HDRP(ptr), PACK(newsize, 1));
-        PUT(FTRP(ptr), PACK(newsize, 1));
+        total = oldsize + GET_SIZE(HDRP(next));
+        if (top)
+            target = total;
+        else if (n < GROW_CHAIN)
+            target = asize;
+        else
+            target = DSIZE * ((asize + asize / 2 + DSIZE - 1) / DSIZE);
+        if (target > total)
+            target = total;
+        if (total - target >= MIN_SPLIT) {
+            PUT(HDRP(ptr), PACK(target, 1));
+            PUT(FTRP(ptr), PACK(target, 1));
+            rest = NEXT_BLKP(ptr);
+            PUT(HDRP(rest), PACK(total - target, 0));
+            PUT(FTRP(rest), PACK(total - target, 0));
+            add_free_block(rest);
+        }
+        else {
+            PUT(HDRP(ptr), PACK(total, 1));
+            PUT(FTRP(ptr), PACK(total, 1));
+        }
+        HDR_AUX(ptr) = GROW_PACK(asize, n);
+        STAT_INC(realloc_inplace);
         return ptr;
     }
 
-    void *newptr = mm_malloc(size);
+    /* 앞 가용 블록까지 합치면 맞으면 앞으로 당겨 옮긴다. 앞에 남은 틈(처음
+     * 블록이 가용 블록 뒤쪽에 놓였거나 체인이 옮겨 가며 남긴 자리)이 다시 쓰인다.
+     * 새 헤더/푸터가 옛 페이로드를 덮을 수 있으니 memmove가 먼저 */
+    copySize = oldsize - OVERHEAD;
+    if (size < copySize)
+        copySize = size;
+    total = back + oldsize + (GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next)));
+    if (back != 0 && total >= asize) {
+        prev = PREV_BLKP(ptr);
+        splice_free_block(prev);
+        if (!GET_ALLOC(HDRP(next)))
+            splice_free_block(next);
+        memmove(prev, ptr, copySize);
+        target = top ? total : DSIZE * ((asize + asize / 2 + DSIZE - 1) / DSIZE);
+        if (target > total || total - target < MIN_SPLIT)
+            target = total;
+        PUT(HDRP(prev), PACK(target, 1));
+        PUT(FTRP(prev), PACK(target, 1));
+        if (target < total) {
+            rest = NEXT_BLKP(prev);
+            PUT(HDRP(rest), PACK(total - target, 0));
+            PUT(FTRP(rest), PACK(total - target, 0));
+            add_free_block(rest);
+        }
+        HDR_AUX(prev) = GROW_PACK(asize, n);
+        STAT_INC(realloc_copy);
+        STAT_ADD(bytes_copied, copySize);
+        return prev;
+    }
+
+    /* 옮김: 체인과 큰 블록은 맞는 가용 블록이 없으면 힙 끝으로.
+     * 큰 블록은 힙 끝에서 페이지 안 위치를 맞춰 페이지째 옮길 수 있게 한다 */
+    if ((n >= GROW_CHAIN || copySize >= REMAP_MIN) && (newptr = find_fit(asize)) != NULL)
+        newptr = place(newptr, asize, 0);
+    else if (copySize >= REMAP_MIN)
+        newptr = place_at_top(asize, ptr);
+    else if (n >= GROW_CHAIN)
+        newptr = place_at_top(asize, NULL);
+    else
+        newptr = do_malloc(size);
     if (newptr == NULL)
         return NULL;
 
-    size_t copySize = oldsize - DSIZE;
-    if (size < copySize)
-        copySize = size;
-    memcpy(newptr, ptr, copySize);
-    mm_free(ptr);
+    remapped = 0;
+    if (copySize >= REMAP_MIN)
+        remapped = mem_remap(newptr, ptr, copySize);
+    else
+        memcpy(newptr, ptr, copySize);
+    HDR_AUX(newptr) = GROW_PACK(asize, n);
+    STAT_INC(realloc_copy);
+    STAT_ADD(bytes_copied, copySize - remapped);
+    STAT_ADD(bytes_remapped, remapped);
+    do_free(ptr);
     return newptr;
 }
+
+/* mm_sync - 미룬 일을 모두 끝낸다. MM_BGTHREAD면 다음 mm_init까지 유지보수
+ * 스레드가 힙을 건드리지 않고 free도 바로 처리한다. 드라이버가 힙을 다른 엔진에
+ * 넘기기 전과, 배치가 스레드가 도는 시점에 좌우되지 않게 이용률을 잴 때 부른다 */
+void mm_sync(void)
+{
+#ifdef MM_BGTHREAD
+    LOCK();
+    drain_deferred();
+    __atomic_store_n(&bg_idle, 1, __ATOMIC_RELAXED);
+    UNLOCK();
+#endif
+}
+
+#ifdef MM_BGTHREAD
+/* drain_deferred - 미룬 free를 모두 처리하고 처리한 수를 돌려준다 (heap_lock을 잡고 부른다) */
+static long drain_deferred(void)
+{
+    char *bp = __atomic_exchange_n(&defer_head, NULL, __ATOMIC_ACQUIRE), *next;
+    long n = 0;
+
+    for (; bp != NULL; bp = next, n++) {
+        next = *(char **)bp;
+        do_free(bp);
+    }
+    __atomic_sub_fetch(&defer_n, n, __ATOMIC_RELAXED);
+    return n;
+}
+
+/* drain_until - 미룬 free를 하나씩 처리하다 asize 이상인 가용 블록이 생기면 멈추고 그 블록을 돌려준다.
+ * 한 번에 다 처리하면 쌓인 만큼 malloc 한 번이 길어진다.
+ * 꺼내는 쪽은 heap_lock을 잡은 하나뿐이라 ABA가 없다. */
+static void *drain_until(size_t asize)
+{
+    char *bp = __atomic_load_n(&defer_head, __ATOMIC_ACQUIRE);
+
+    while (bp != NULL) {
+        if (!__atomic_compare_exchange_n(&defer_head, &bp, *(char **)bp, 1,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            continue;
+        __atomic_sub_fetch(&defer_n, 1, __ATOMIC_RELAXED);
+        bp = do_free(bp);
+        if (GET_SIZE(HDRP(bp)) >= asize)
+            return bp;
+        bp = __atomic_load_n(&defer_head, __ATOMIC_ACQUIRE);
+    }
+    return NULL;
+}
+
+/* trim_top - 힙 끝 가용 블록이 TRIM_KEEP보다 크면 넘는 페이지를 OS에 돌려준다
+ * (brk는 줄일 수 없으니 MADV_DONTNEED로 물리 페이지만). 블록 앞부분(헤더, 링크)과
+ * 푸터가 있는 마지막 페이지는 남긴다. heap_lock을 잡고 부른다. */
+static void trim_top(void)
+{
+    size_t page = mem_pagesize(), have;
+    char *lo, *hi;
+
+    if (PREV_ALLOC(heap_top) || (have = GET_SIZE(heap_top - OVERHEAD)) <= TRIM_KEEP)
+        return;
+    lo = (char *)(((size_t)heap_top - have + TRIM_KEEP + page - 1) & ~(page - 1));
+    hi = (char *)((size_t)(heap_top - OVERHEAD) & ~(page - 1));
+    if (lo < hi && (lo != trim_lo || hi != trim_hi)) {
+        madvise(lo, hi - lo, MADV_DONTNEED);
+        trim_lo = lo;
+        trim_hi = hi;
+    }
+}
+
+/* grow_top - 힙 끝 가용 블록이 params.low_water보다 작으면 malloc이 모자라기 전에
+ * 미리 힙을 늘린다. heap_lock을 잡고 부른다. */
+static void grow_top(void)
+{
+    size_t have = PREV_ALLOC(heap_top) ? 0 : GET_SIZE(heap_top - OVERHEAD);
+    size_t size;
+
+    if (have >= params.low_water)
+        return;
+    size = MAX(CHUNKSIZE, (params.low_water - have + DSIZE - 1) & ~(size_t)(DSIZE - 1));
+    extend_heap(size / WSIZE);
+}
+
+/* bg_main - 유지보수 스레드 */
+static void *bg_main(void *arg)
+{
+    struct timespec ts;
+    char *lo, *hi;
+    unsigned long gen;
+
+    for (;;) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += BG_INTERVAL;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&bg_sem, &ts);
+
+        LOCK();
+        lo = hi = NULL;
+        gen = heap_gen;
+        if (!bg_idle) {
+            drain_deferred();
+            if (params.low_water != 0)
+                grow_top();
+            trim_top();
+            /* 힙 끝 너머 fault는 내용을 바꾸지 않으니 락을 놓고 한다 */
+            if (params.prefault != 0 && fault_end < heap_top + params.prefault / 2) {
+                lo = MAX(fault_end, heap_top);
+                hi = heap_top + params.prefault;
+            }
+        }
+        UNLOCK();
+        if (lo < hi) {
+            mem_prefault(lo, hi - lo);
+            /* mem_touch는 mem_sbrk와 같은 변수를 쓰니 락 안에서. mm_sync 뒤에는
+             * 드라이버가 락 없이 힙을 되돌리므로 건드리지 않는다 */
+            LOCK();
+            if (gen == heap_gen && !bg_idle) {
+                fault_end = hi;
+                mem_touch(hi);
+            }
+            UNLOCK();
+        }
+    }
+    return NULL;
+}
+
+/* bg_start - 프로세스마다 한 번 유지보수 스레드를 띄운다 */
+static int bg_start(void)
+{
+    pthread_t tid;
+
+    if (bg_pid == getpid())
+        return 0;
+    if (bg_pid != 0)  /* fork한 자식: 스레드는 따라오지 않았다 */
+        pthread_mutex_init(&heap_lock, NULL);
+    if (sem_init(&bg_sem, 0, 0) < 0 || pthread_create(&tid, NULL, bg_main, NULL) != 0)
+        return -1;
+    pthread_detach(tid);
+    bg_pid = getpid();
+    return 0;
+}
+#endif /* MM_BGTHREAD */
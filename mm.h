@@ -1,9 +1,72 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern void mm_freeinfo(size_t *nfree, size_t *free_bytes, size_t *largest);
+
+/*
+ * mm_sync finishes any work the allocator has deferred (a maintenance
+ * thread's pending frees) and keeps that thread off the heap until the
+ * next mm_init, with mm_free doing its work at once in the meantime.
+ * The driver calls it before it hands the heap to another allocator,
+ * and right after mm_init when it measures utilization, so that block
+ * placement doesn't depend on when the thread runs.
+ */
+extern void mm_sync(void);
+extern size_t mm_block_size(size_t size);
+
+/* mm_heap_walk calls fn on every block, in address order, with the
+   start of the block (its header, if it has one), the payload and the
+   size of the whole block */
+typedef void (*mm_walk_fn)(void *blk, void *bp, size_t size, int alloc, void *arg);
+extern void mm_heap_walk(mm_walk_fn fn, void *arg);
+
+/*
+ * Event counters, kept only when mm.c is built with -DMM_STATS (make
+ * MM_STATS=1) and reset by mm_init. mm_get_stats returns 0 if the
+ * counters were compiled out.
+ */
+typedef struct {
+    unsigned long fit_steps;       /* free blocks looked at by find_fit */
+    unsigned long insert_steps;    /* free blocks passed by add_free_block */
+    unsigned long splits;          /* blocks split by place */
+    unsigned long coalesce[4];     /* coalesce with no/next/prev/both neighbors */
+    unsigned long extends;         /* extend_heap calls */
+    unsigned long realloc_inplace; /* reallocs that kept their block */
+    unsigned long realloc_copy;    /* reallocs that moved to a new block */
+    unsigned long bytes_copied;    /* bytes memcpy'd by moving reallocs */
+    unsigned long bytes_remapped;  /* bytes moved by remapping pages */
+} mm_stats_t;
+extern int mm_get_stats(mm_stats_t *st);
+
+/*
+ * Tuning parameters. The defaults are the MM_* macros in mm.c, which a
+ * header written by mdriver -T can override (make MM_TUNED=file.h).
+ * mm_set_params returns -1, and changes nothing, if they are invalid
+ * or the allocator has none. New values apply to the next request.
+ */
+typedef struct {
+    size_t chunksize;  /* least amount the heap grows by */
+    size_t min_split;  /* split a block only if this much is left over */
+    size_t min_block;  /* smallest block */
+    size_t round;      /* block sizes are multiples of this */
+    size_t tail_min;   /* mallocs of blocks this big take the tail of a
+                          free block, smaller ones the front (0: all front) */
+    size_t prefault;   /* bytes past the end of the heap kept faulted in,
+                          so growing it doesn't fault (0: none) */
+    size_t low_water;  /* the MM_BGTHREAD thread grows the heap before the
+                          free block at its end gets smaller than this
+                          (0, or no thread: when a malloc misses) */
+} mm_params_t;
+extern int mm_set_params(const mm_params_t *p);
+extern void mm_get_params(mm_params_t *p);
 
 
 /* 
@@ -21,3 +84,4 @@ typedef struct {
 
 extern team_t team;
 
+#endif /* __MM_H_ */
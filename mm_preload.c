@@ -0,0 +1,216 @@
+/*
+ * mm_preload.c - the C library allocation interface on top of mm.c, for
+ *     libmm.so. Preloading the library runs mm.c under real programs:
+ *
+ *         unix> LD_PRELOAD=./libmm.so some-program
+ *
+ * mm.c is single-threaded, so every entry point takes one global lock.
+ * The allocator initializes itself on the first call, whenever that is:
+ * the dynamic loader and libc call malloc long before any constructor
+ * of ours runs, so there is nothing to order. The static mutex needs no
+ * initialization and mem_init only calls mmap. The fork handlers take
+ * the lock around fork(), so the child never inherits a heap that
+ * another thread was halfway through changing.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#ifdef MM_BGTHREAD
+#error "mm_init runs inside the first malloc here, where it can't start a thread"
+#endif
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* mm.c keeps block sizes in 32-bit header words */
+#define MAX_REQUEST ((size_t)1 << 31)
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int mm_ready = 0;
+
+/*
+ * mm_start - Initialize the heap on first use. Called with mm_lock held.
+ */
+static int mm_start(void)
+{
+    if (!mm_ready) {
+        mem_init();
+        if (mm_init() < 0)
+            return -1;
+        mm_ready = 1;
+    }
+    return 0;
+}
+
+/*
+ * Fork handlers
+ */
+static void mm_prefork(void)
+{
+    pthread_mutex_lock(&mm_lock);
+}
+
+static void mm_postfork(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+__attribute__((constructor))
+static void mm_preload_init(void)
+{
+    pthread_atfork(mm_prefork, mm_postfork, mm_postfork);
+}
+
+/*
+ * The C library interface
+ */
+EXPORT void *malloc(size_t size)
+{
+    void *p = NULL;
+
+    if (size >= MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&mm_lock);
+    if (mm_start() == 0)
+        p = mm_malloc(size ? size : 1);
+    pthread_mutex_unlock(&mm_lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    pthread_mutex_lock(&mm_lock);
+    mm_free(ptr);
+    pthread_mutex_unlock(&mm_lock);
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if (size >= MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&mm_lock);
+    p = mm_realloc(ptr, size);
+    pthread_mutex_unlock(&mm_lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * calloc calls mm_malloc, not malloc: gcc turns malloc followed by
+ * memset(0) into a call to calloc, which would recurse forever here.
+ */
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    void *p = NULL;
+
+    if (size != 0 && nmemb > (MAX_REQUEST - 1) / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size *= nmemb;
+    pthread_mutex_lock(&mm_lock);
+    if (mm_start() == 0)
+        p = mm_malloc(size ? size : 1);
+    pthread_mutex_unlock(&mm_lock);
+    if (p == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memset(p, 0, size);
+}
+
+/*
+ * reallocarray must be ours too: the one in libc calls its own realloc
+ * directly, which would be handed a pointer from our heap.
+ */
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > (MAX_REQUEST - 1) / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    void *p = NULL;
+
+    if (align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size >= MAX_REQUEST || align >= MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&mm_lock);
+    if (mm_start() == 0)
+        p = mm_memalign(align, size ? size : 1);
+    pthread_mutex_unlock(&mm_lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align == 0 || align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+        return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    size_t size;
+
+    if (ptr == NULL)
+        return 0;
+    pthread_mutex_lock(&mm_lock);
+    size = mm_usable_size(ptr);
+    pthread_mutex_unlock(&mm_lock);
+    return size;
+}
@@ -0,0 +1,438 @@
+/*
+ * mtbench.c - Multi-threaded benchmark for the mm.h allocator interface
+ *
+ * mdriver replays single-threaded traces; this program measures how the
+ * allocator behaves when several threads use it at once. Workloads:
+ *
+ *   churn     Each thread keeps its own set of live blocks and randomly
+ *             frees and reallocates them. No sharing between threads.
+ *   larson    All threads share one array of blocks. Each op swaps a
+ *             new block into a random slot and frees the old one, which
+ *             was usually allocated by another thread (after Larson and
+ *             Krishnan's server benchmark).
+ *   prodcons  Threads form a ring of queues: each allocates blocks and
+ *             passes them to the next thread, which frees them, so every
+ *             free happens on a different thread than the malloc.
+ *
+ * Each workload runs for 1, 2, 4, ... up to -t threads, each thread
+ * doing the same number of ops, and the program reports throughput, the
+ * speedup and scalability efficiency relative to one thread
+ * (efficiency = speedup / threads), and the peak heap size.
+ *
+ * mm.c is not thread-safe, so every call goes through one global lock.
+ * Build with -DMM_THREADSAFE to call an allocator that does its own
+ * locking directly; the numbers for the two are then comparable.
+ *
+ * The first word of every block holds its size and is checked on free,
+ * so a concurrent allocator that hands out overlapping blocks fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Defaults for the command line options */
+#define DEFAULT_THREADS 8
+#define DEFAULT_OPS 200000
+#define DEFAULT_SLOTS 1000
+#define DEFAULT_MINSIZE 8
+#define DEFAULT_MAXSIZE 256
+
+#define QUEUE_LEN 1024 /* blocks in flight between two prodcons threads */
+
+/* Single-producer single-consumer queue between two prodcons threads */
+typedef struct
+{
+	void *item[QUEUE_LEN];
+	volatile unsigned long head __attribute__((aligned(64)));
+	volatile unsigned long tail __attribute__((aligned(64)));
+} queue_t;
+
+/* Per-thread arguments and results */
+typedef struct
+{
+	int id;
+	uint64_t rng;
+	long ops;	 /* allocator calls made */
+	long errors; /* blocks whose contents were corrupted */
+} thread_t;
+
+typedef void *(*workload_fn)(void *);
+
+/* Settings, shared read-only by all threads */
+static int nthreads;
+static long nops = DEFAULT_OPS;
+static int nslots = DEFAULT_SLOTS;
+static size_t minsize = DEFAULT_MINSIZE;
+static size_t maxsize = DEFAULT_MAXSIZE;
+
+/* Shared state of the current run */
+static pthread_barrier_t start_barrier;
+static void *volatile *shared_slots;
+static queue_t *queues;
+
+#ifndef MM_THREADSAFE
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&mm_lock)
+#define UNLOCK() pthread_mutex_unlock(&mm_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+static void usage(void);
+static void unix_error(char *msg);
+static void app_error(char *msg);
+
+/***************************
+ * Allocator calls
+ ***************************/
+
+/* xorshift64: one private generator per thread */
+static uint64_t rng_next(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/*
+ * bench_malloc - Allocate a block of random size and tag it
+ */
+static void *bench_malloc(thread_t *t)
+{
+	size_t size = minsize + rng_next(&t->rng) % (maxsize - minsize + 1);
+	size_t *p;
+
+	LOCK();
+	p = mm_malloc(size);
+	UNLOCK();
+	if (p == NULL)
+		app_error("mm_malloc failed");
+	*p = size;
+	t->ops++;
+	return p;
+}
+
+/*
+ * bench_free - Check the tag of a block and free it
+ */
+static void bench_free(thread_t *t, void *p)
+{
+	size_t size = *(size_t *)p;
+
+	if (size < minsize || size > maxsize)
+		t->errors++;
+	LOCK();
+	mm_free(p);
+	UNLOCK();
+	t->ops++;
+}
+
+/***************************
+ * Workloads
+ ***************************/
+
+/*
+ * churn - Random frees and mallocs over a private set of slots
+ */
+static void *churn(void *arg)
+{
+	thread_t *t = arg;
+	void **slot = calloc(nslots, sizeof(void *));
+	long i;
+	int k;
+
+	if (slot == NULL)
+		unix_error("calloc failed in churn");
+	pthread_barrier_wait(&start_barrier);
+	for (i = 0; i < nops; i++)
+	{
+		k = rng_next(&t->rng) % nslots;
+		if (slot[k] != NULL)
+		{
+			bench_free(t, slot[k]);
+			slot[k] = NULL;
+		}
+		else
+			slot[k] = bench_malloc(t);
+	}
+	for (k = 0; k < nslots; k++)
+		if (slot[k] != NULL)
+			bench_free(t, slot[k]);
+	free(slot);
+	return NULL;
+}
+
+/*
+ * larson - Swap new blocks into random slots of the shared array and
+ *     free whatever was there
+ */
+static void *larson(void *arg)
+{
+	thread_t *t = arg;
+	long i;
+	int k;
+	void *p;
+
+	pthread_barrier_wait(&start_barrier);
+	for (i = 0; i < nops / 2; i++)
+	{
+		k = rng_next(&t->rng) % (nslots * nthreads);
+		p = __atomic_exchange_n(&shared_slots[k], bench_malloc(t),
+								__ATOMIC_ACQ_REL);
+		if (p != NULL)
+			bench_free(t, p);
+	}
+	return NULL;
+}
+
+/*
+ * prodcons - Pass blocks to the next thread through a queue and free
+ *     the blocks the previous thread passes in
+ */
+static void *prodcons(void *arg)
+{
+	thread_t *t = arg;
+	queue_t *out = &queues[t->id];
+	queue_t *in = &queues[(t->id + nthreads - 1) % nthreads];
+	long produced = 0, consumed = 0;
+	int progress;
+
+	pthread_barrier_wait(&start_barrier);
+	while (produced < nops / 2 || consumed < nops / 2)
+	{
+		progress = 0;
+		if (produced < nops / 2 &&
+			out->tail - __atomic_load_n(&out->head, __ATOMIC_ACQUIRE) < QUEUE_LEN)
+		{
+			out->item[out->tail % QUEUE_LEN] = bench_malloc(t);
+			__atomic_store_n(&out->tail, out->tail + 1, __ATOMIC_RELEASE);
+			produced++;
+			progress = 1;
+		}
+		if (consumed < nops / 2 &&
+			__atomic_load_n(&in->tail, __ATOMIC_ACQUIRE) != in->head)
+		{
+			bench_free(t, in->item[in->head % QUEUE_LEN]);
+			__atomic_store_n(&in->head, in->head + 1, __ATOMIC_RELEASE);
+			consumed++;
+			progress = 1;
+		}
+		if (!progress)
+			sched_yield();
+	}
+	return NULL;
+}
+
+/***************************
+ * Running the benchmark
+ ***************************/
+
+/*
+ * run - Run one workload on n threads. Returns the wall-clock time and
+ *     fills in the total ops, errors and the peak heap size.
+ */
+static double run(workload_fn fn, int n, uint64_t seed,
+				  long *ops, long *errors, size_t *heap)
+{
+	pthread_t *tid = malloc(n * sizeof(pthread_t));
+	thread_t *t = calloc(n, sizeof(thread_t));
+	thread_t rest;
+	struct timespec start, end;
+	int i;
+
+	if (tid == NULL || t == NULL)
+		unix_error("malloc failed in run");
+
+	/* Every run starts from an empty heap */
+	mm_sync();
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed");
+
+	nthreads = n;
+	if ((shared_slots = calloc((size_t)nslots * n, sizeof(void *))) == NULL)
+		unix_error("calloc failed in run");
+	if (posix_memalign((void **)&queues, 64, n * sizeof(queue_t)) != 0)
+		unix_error("posix_memalign failed in run");
+	memset(queues, 0, n * sizeof(queue_t));
+	pthread_barrier_init(&start_barrier, NULL, n + 1);
+
+	for (i = 0; i < n; i++)
+	{
+		t[i].id = i;
+		t[i].rng = seed * 0x9E3779B97F4A7C15ULL + i + 1;
+		if (pthread_create(&tid[i], NULL, fn, &t[i]) != 0)
+			app_error("pthread_create failed");
+	}
+	pthread_barrier_wait(&start_barrier);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		pthread_join(tid[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* Blocks still in the shared array are freed outside the timing */
+	memset(&rest, 0, sizeof(rest));
+	for (i = 0; i < nslots * n; i++)
+		if (shared_slots[i] != NULL)
+			bench_free(&rest, shared_slots[i]);
+	*ops = 0;
+	*errors = rest.errors;
+	for (i = 0; i < n; i++)
+	{
+		*ops += t[i].ops;
+		*errors += t[i].errors;
+	}
+	*heap = mem_heapsize();
+
+	pthread_barrier_destroy(&start_barrier);
+	free((void *)shared_slots);
+	free(queues);
+	free(tid);
+	free(t);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct
+	{
+		char *name;
+		workload_fn fn;
+	} workloads[] = {
+		{"churn", churn},
+		{"larson", larson},
+		{"prodcons", prodcons},
+	};
+	int nworkloads = sizeof(workloads) / sizeof(workloads[0]);
+	int maxthreads = DEFAULT_THREADS;
+	char *only = NULL;
+	uint64_t seed = 1;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int c, w, n;
+
+	while ((c = getopt(argc, argv, "t:n:l:s:m:M:w:h")) != EOF)
+	{
+		switch (c)
+		{
+		case 't': /* Largest thread count in the sweep */
+			maxthreads = atoi(optarg);
+			break;
+		case 'n': /* Allocator calls per thread */
+			nops = atol(optarg);
+			break;
+		case 'l': /* Live block slots per thread */
+			nslots = atoi(optarg);
+			break;
+		case 's': /* Random seed */
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'm': /* Smallest request */
+			minsize = atol(optarg);
+			break;
+		case 'M': /* Largest request */
+			maxsize = atol(optarg);
+			break;
+		case 'w': /* Run only this workload */
+			only = optarg;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (maxthreads < 1 || nops < 2 || nslots < 1 ||
+		minsize < sizeof(size_t) || maxsize < minsize)
+	{
+		usage();
+		exit(1);
+	}
+
+#ifdef MM_THREADSAFE
+	printf("Allocator does its own locking\n");
+#else
+	printf("Allocator calls serialized by one global lock\n");
+#endif
+	if (maxthreads > ncpus)
+		printf("Note: %ld CPUs online; runs with more threads share them\n", ncpus);
+	printf("%ld ops per thread, %d slots per thread, sizes %zu-%zu\n\n",
+		   nops, nslots, minsize, maxsize);
+	printf("%-10s%8s%10s%9s%11s%12s%8s\n",
+		   "workload", "threads", "Mops/s", "speedup", "efficiency", "peak heap", "errors");
+
+	mem_init();
+	for (w = 0; w < nworkloads; w++)
+	{
+		double base = 0;
+
+		if (only != NULL && strcmp(only, workloads[w].name) != 0)
+			continue;
+		for (n = 1;; n = (2 * n > maxthreads && n < maxthreads) ? maxthreads : 2 * n)
+		{
+			long ops, errors;
+			size_t heap;
+			double secs = run(workloads[w].fn, n, seed, &ops, &errors, &heap);
+			double thru = ops / secs / 1e6;
+
+			if (n == 1)
+				base = thru;
+			printf("%-10s%8d%10.2f%9.2f%10.0f%%%9.1f MB%8ld\n",
+				   workloads[w].name, n, thru, thru / base,
+				   100.0 * thru / base / n, heap / 1048576.0, errors);
+			if (errors)
+				app_error("allocator returned corrupted blocks");
+			if (n >= maxthreads)
+				break;
+		}
+	}
+	mem_deinit();
+	return 0;
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+	fprintf(stderr, "mtbench: %s\n", msg);
+	exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mtbench [-h] [-t <threads>] [-n <ops>] [-l <slots>] [-s <seed>]\n");
+	fprintf(stderr, "               [-m <min>] [-M <max>] [-w churn|larson|prodcons]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h          Print this message.\n");
+	fprintf(stderr, "\t-t <n>      Sweep thread counts 1, 2, 4, ... up to n (default %d).\n", DEFAULT_THREADS);
+	fprintf(stderr, "\t-n <n>      Allocator calls per thread (default %d).\n", DEFAULT_OPS);
+	fprintf(stderr, "\t-l <n>      Live block slots per thread (default %d).\n", DEFAULT_SLOTS);
+	fprintf(stderr, "\t-s <seed>   Random seed (default 1).\n");
+	fprintf(stderr, "\t-m <bytes>  Smallest request, at least 8 (default %d).\n", DEFAULT_MINSIZE);
+	fprintf(stderr, "\t-M <bytes>  Largest request (default %d).\n", DEFAULT_MAXSIZE);
+	fprintf(stderr, "\t-w <name>   Run only one workload.\n");
+}
@@ -0,0 +1,635 @@
+/*
+ * record.c - librecord.so, an allocation trace recorder for real
+ *     programs. Preload it to capture every malloc/calloc/realloc/free
+ *     (and the memalign family) of a process as a Malloc Lab trace:
+ *
+ *         unix> LD_PRELOAD=./librecord.so MM_RECORD_FILE=app.rep app
+ *         unix> mdriver -f app.rep
+ *
+ * The calls themselves go to glibc (through its __libc_* entry points,
+ * so no dlsym bootstrapping is needed). Each thread logs its calls into
+ * a buffer of its own and appends the full buffer to a raw log file with
+ * one write(), so the hot path takes no locks. Every event gets a number
+ * from a global counter: frees take theirs before the block goes back
+ * to glibc, allocations after they get it, so an address reused by
+ * another thread always appears freed before it is handed out again.
+ *
+ * At exit the raw log is sorted by event number and turned into a .rep
+ * file: each allocation gets a fresh id that follows it through its
+ * reallocs, frees of blocks we never saw are dropped, and frees are
+ * appended for the blocks still live at exit, like checktrace.pl does.
+ *
+ * Environment:
+ *   MM_RECORD_FILE   output trace (default mm-%p.rep); %p stands for
+ *                    the process id. Forked or exec'd children write
+ *                    <file>.<pid> unless the name already has a %p.
+ *   MM_RECORD_META   if set, also write <file>.meta with the thread id
+ *                    and CLOCK_MONOTONIC time (ns) of each trace op
+ *   MM_RECORD_RAW    if set, keep the raw log <file>.raw
+ *
+ * Nothing on the recording path may call malloc.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define EXPORT __attribute__((visibility("default")))
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+#define MAXPATH 1024
+#define BUFEVENTS 4096 /* events per thread buffer */
+
+/* The glibc allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t align, size_t size);
+
+/* One logged call */
+typedef struct
+{
+	uint64_t seq;  /* global event number */
+	uint64_t ns;   /* CLOCK_MONOTONIC time (only with MM_RECORD_META) */
+	uintptr_t ptr; /* block returned (ALLOC, REALLOC) or freed (FREE) */
+	uintptr_t old; /* block passed to realloc */
+	uint64_t size; /* requested bytes */
+	uint32_t tid;  /* thread id */
+	uint32_t type; /* EV_xxx */
+} event_t;
+
+enum { EV_ALLOC, EV_REALLOC, EV_FREE };
+
+/* Per-thread event buffer; all of them are kept on a list for exit */
+typedef struct evbuf_t
+{
+	struct evbuf_t *next;
+	int count;
+	event_t ev[BUFEVENTS];
+} evbuf_t;
+
+static volatile int recording = 0; /* set while we log calls */
+static int with_meta = 0;		   /* MM_RECORD_META */
+static int keep_raw = 0;		   /* MM_RECORD_RAW */
+static int raw_fd = -1;			   /* raw log */
+static char out_tmpl[MAXPATH];	   /* .rep file name template for children */
+static char out_path[MAXPATH];	   /* .rep file */
+static char raw_path[MAXPATH];	   /* raw log file */
+static pthread_mutex_t raw_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t next_seq = 0;	   /* global event counter */
+static evbuf_t *all_bufs = NULL;   /* list of all thread buffers */
+static pthread_mutex_t bufs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t buf_key;
+
+static TLS evbuf_t *my_buf = NULL;
+static TLS uint32_t my_tid = 0;
+static TLS int in_hook = 0; /* guards against recursion through libc */
+
+/*
+ * open_raw - Create the raw log on the first flush, so that a forked
+ *     child that execs right away leaves no empty log behind
+ */
+static void open_raw(void)
+{
+	pthread_mutex_lock(&raw_lock);
+	if (raw_fd < 0)
+	{
+		raw_fd = open(raw_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+					  0644);
+		if (raw_fd < 0)
+		{
+			perror(raw_path);
+			recording = 0;
+		}
+	}
+	pthread_mutex_unlock(&raw_lock);
+}
+
+/*
+ * flush_buf - Append a thread buffer to the raw log
+ */
+static void flush_buf(evbuf_t *b)
+{
+	size_t len = b->count * sizeof(event_t);
+	char *p = (char *)b->ev;
+	ssize_t n;
+
+	if (len > 0 && raw_fd < 0)
+		open_raw();
+	while (len > 0 && raw_fd >= 0)
+	{
+		if ((n = write(raw_fd, p, len)) <= 0)
+			break;
+		p += n;
+		len -= n;
+	}
+	b->count = 0;
+}
+
+/*
+ * thread_exit - pthread key destructor: flush the buffer of a dying thread
+ */
+static void thread_exit(void *arg)
+{
+	flush_buf((evbuf_t *)arg);
+}
+
+/*
+ * get_buf - The calling thread's buffer, mapped on first use
+ */
+static evbuf_t *get_buf(void)
+{
+	evbuf_t *b;
+
+	if (my_buf != NULL)
+		return my_buf;
+	b = mmap(NULL, sizeof(evbuf_t), PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b == MAP_FAILED)
+		return NULL;
+	b->count = 0;
+	pthread_mutex_lock(&bufs_lock);
+	b->next = all_bufs;
+	all_bufs = b;
+	pthread_mutex_unlock(&bufs_lock);
+	pthread_setspecific(buf_key, b);
+	my_tid = (uint32_t)syscall(SYS_gettid);
+	return my_buf = b;
+}
+
+/*
+ * log_event - Log one call. seq must already be taken (see top of file).
+ */
+static void log_event(uint64_t seq, int type, void *ptr, void *old,
+					  size_t size)
+{
+	evbuf_t *b;
+	event_t *e;
+
+	if ((b = get_buf()) == NULL)
+		return;
+	e = &b->ev[b->count];
+	e->seq = seq;
+	e->type = type;
+	e->ptr = (uintptr_t)ptr;
+	e->old = (uintptr_t)old;
+	e->size = size;
+	e->tid = my_tid;
+	e->ns = 0;
+	if (with_meta)
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		e->ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+	if (++b->count == BUFEVENTS)
+		flush_buf(b);
+}
+
+static uint64_t take_seq(void)
+{
+	return __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * The C library interface
+ */
+EXPORT void *malloc(size_t size)
+{
+	void *p = __libc_malloc(size);
+
+	if (recording && p != NULL && !in_hook)
+	{
+		in_hook = 1;
+		log_event(take_seq(), EV_ALLOC, p, NULL, size);
+		in_hook = 0;
+	}
+	return p;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+	void *p = __libc_calloc(nmemb, size);
+
+	if (recording && p != NULL && !in_hook)
+	{
+		in_hook = 1;
+		log_event(take_seq(), EV_ALLOC, p, NULL, nmemb * size);
+		in_hook = 0;
+	}
+	return p;
+}
+
+EXPORT void free(void *ptr)
+{
+	if (recording && ptr != NULL && !in_hook)
+	{
+		in_hook = 1;
+		log_event(take_seq(), EV_FREE, ptr, NULL, 0);
+		in_hook = 0;
+	}
+	__libc_free(ptr);
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+	uint64_t seq = 0;
+	void *p;
+
+	/* realloc(p, 0) frees p, so it must be numbered like a free */
+	if (recording && ptr != NULL && size == 0 && !in_hook)
+		seq = take_seq();
+	p = __libc_realloc(ptr, size);
+	if (recording && !in_hook)
+	{
+		in_hook = 1;
+		if (ptr != NULL && size == 0)
+			log_event(seq, EV_FREE, ptr, NULL, 0);
+		else if (p != NULL)
+			log_event(take_seq(), EV_REALLOC, p, ptr, size);
+		in_hook = 0;
+	}
+	return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		return NULL;
+	return realloc(ptr, nmemb * size);
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+	void *p = __libc_memalign(align, size);
+
+	if (recording && p != NULL && !in_hook)
+	{
+		in_hook = 1;
+		log_event(take_seq(), EV_ALLOC, p, NULL, size);
+		in_hook = 0;
+	}
+	return p;
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+	void *p;
+
+	if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+		return 22; /* EINVAL */
+	if ((p = memalign(align, size)) == NULL)
+		return 12; /* ENOMEM */
+	*memptr = p;
+	return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+	return memalign(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+	return memalign(getpagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+	size_t page = getpagesize();
+	return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+/**********************************************
+ * Converting the raw log into a .rep file
+ *********************************************/
+
+/* Open-addressing map from live block address to trace id */
+typedef struct
+{
+	uintptr_t *key; /* 0 = empty slot */
+	int *id;
+	size_t mask;
+	size_t used;
+} idmap_t;
+
+static void *map_alloc(size_t bytes)
+{
+	void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return (p == MAP_FAILED) ? NULL : p;
+}
+
+static int idmap_init(idmap_t *m, size_t slots)
+{
+	m->mask = slots - 1;
+	m->used = 0;
+	m->key = map_alloc(slots * sizeof(uintptr_t));
+	m->id = map_alloc(slots * sizeof(int));
+	return (m->key != NULL && m->id != NULL) ? 0 : -1;
+}
+
+static void idmap_free(idmap_t *m)
+{
+	munmap(m->key, (m->mask + 1) * sizeof(uintptr_t));
+	munmap(m->id, (m->mask + 1) * sizeof(int));
+}
+
+static size_t idmap_slot(idmap_t *m, uintptr_t key)
+{
+	size_t i = (key >> 4) * 0x9E3779B97F4A7C15ULL;
+
+	for (i &= m->mask; m->key[i] != 0 && m->key[i] != key; i = (i + 1) & m->mask)
+		;
+	return i;
+}
+
+static int idmap_put(idmap_t *m, uintptr_t key, int id)
+{
+	size_t i;
+
+	if (2 * (m->used + 1) > m->mask + 1)
+	{
+		idmap_t big;
+		size_t j;
+
+		if (idmap_init(&big, 2 * (m->mask + 1)) < 0)
+			return -1;
+		for (j = 0; j <= m->mask; j++)
+			if (m->key[j] != 0)
+			{
+				i = idmap_slot(&big, m->key[j]);
+				big.key[i] = m->key[j];
+				big.id[i] = m->id[j];
+				big.used++;
+			}
+		idmap_free(m);
+		*m = big;
+	}
+	i = idmap_slot(m, key);
+	if (m->key[i] == 0)
+		m->used++;
+	m->key[i] = key;
+	m->id[i] = id;
+	return 0;
+}
+
+/* Returns the id of key and removes it, or -1 if key isn't live */
+static int idmap_take(idmap_t *m, uintptr_t key)
+{
+	size_t i = idmap_slot(m, key), j, k;
+	int id;
+
+	if (m->key[i] == 0)
+		return -1;
+	id = m->id[i];
+
+	/* Backward-shift deletion keeps the probe chains intact */
+	m->key[i] = 0;
+	m->used--;
+	for (j = (i + 1) & m->mask; m->key[j] != 0; j = (j + 1) & m->mask)
+	{
+		k = (m->key[j] >> 4) * 0x9E3779B97F4A7C15ULL & m->mask;
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+		{
+			m->key[i] = m->key[j];
+			m->id[i] = m->id[j];
+			m->key[j] = 0;
+			i = j;
+		}
+	}
+	return id;
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+	uint64_t x = ((const event_t *)a)->seq, y = ((const event_t *)b)->seq;
+	return (x > y) - (x < y);
+}
+
+/*
+ * replay - Walk the sorted events once. With out == NULL only count the
+ *     ops and ids and find the peak live bytes; otherwise write the trace
+ *     lines (and the meta lines, if meta != NULL).
+ */
+static int replay(event_t *ev, size_t n, FILE *out, FILE *meta,
+				  int *num_ids, int *num_ops, uint64_t *peak)
+{
+	idmap_t map;
+	uint64_t *sizes = NULL; /* current size of each id */
+	size_t maxids = 0;
+	uint64_t live = 0;
+	size_t i;
+	int id, nid = 0, nops = 0;
+
+	if (idmap_init(&map, 1024) < 0)
+		return -1;
+	*peak = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		event_t *e = &ev[i];
+		uint64_t size = e->size ? e->size : 1; /* mm_malloc(0) is NULL */
+
+		id = -1;
+		if (e->type == EV_REALLOC && e->old != 0)
+			id = idmap_take(&map, e->old);
+		if (e->type == EV_FREE)
+		{
+			if ((id = idmap_take(&map, e->ptr)) < 0)
+				continue; /* block from before we started */
+			live -= sizes[id];
+			if (out)
+				fprintf(out, "f %d\n", id);
+		}
+		else
+		{
+			if (id < 0)
+			{
+				/* A new block (or a realloc of a block we never saw) */
+				id = nid++;
+				if ((size_t)id >= maxids)
+				{
+					uint64_t *s = map_alloc(2 * (maxids + 4096) * sizeof(uint64_t));
+					if (s == NULL)
+						return -1;
+					if (sizes)
+					{
+						memcpy(s, sizes, maxids * sizeof(uint64_t));
+						munmap(sizes, maxids * sizeof(uint64_t));
+					}
+					sizes = s;
+					maxids = 2 * (maxids + 4096);
+				}
+				sizes[id] = 0;
+				if (out)
+					fprintf(out, "a %d %llu\n", id, (unsigned long long)size);
+			}
+			else if (out)
+				fprintf(out, "r %d %llu\n", id, (unsigned long long)size);
+			live += size - sizes[id];
+			sizes[id] = size;
+			if (live > *peak)
+				*peak = live;
+			if (idmap_put(&map, e->ptr, id) < 0)
+				return -1;
+		}
+		if (meta)
+			fprintf(meta, "%d %u %llu\n", nops, e->tid, (unsigned long long)e->ns);
+		nops++;
+	}
+
+	/* Balance the trace */
+	for (i = 0; i <= map.mask; i++)
+		if (map.key[i] != 0)
+		{
+			if (out)
+				fprintf(out, "f %d\n", map.id[i]);
+			nops++;
+		}
+
+	idmap_free(&map);
+	if (sizes)
+		munmap(sizes, maxids * sizeof(uint64_t));
+	*num_ids = nid;
+	*num_ops = nops;
+	return 0;
+}
+
+/*
+ * write_trace - Turn the raw log into the .rep file
+ */
+static void write_trace(void)
+{
+	struct stat st;
+	event_t *ev;
+	size_t n;
+	FILE *out, *meta = NULL;
+	char meta_path[MAXPATH + 8];
+	int num_ids, num_ops;
+	uint64_t peak;
+
+	if (raw_fd < 0 || fstat(raw_fd, &st) < 0 || st.st_size == 0)
+		return;
+	n = st.st_size / sizeof(event_t);
+	ev = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, raw_fd, 0);
+	if (ev == MAP_FAILED)
+	{
+		perror("librecord: mmap");
+		return;
+	}
+	qsort(ev, n, sizeof(event_t), cmp_seq);
+
+	if (replay(ev, n, NULL, NULL, &num_ids, &num_ops, &peak) < 0 ||
+		(out = fopen(out_path, "w")) == NULL)
+	{
+		perror("librecord: can't write trace");
+		munmap(ev, st.st_size);
+		return;
+	}
+	if (with_meta)
+	{
+		sprintf(meta_path, "%s.meta", out_path);
+		if ((meta = fopen(meta_path, "w")) != NULL)
+			fprintf(meta, "# op tid ns\n");
+	}
+	fprintf(out, "%llu\n%d\n%d\n1\n", (unsigned long long)peak, num_ids, num_ops);
+	replay(ev, n, out, meta, &num_ids, &num_ops, &peak);
+	fclose(out);
+	if (meta)
+		fclose(meta);
+	munmap(ev, st.st_size);
+}
+
+/*
+ * start_recording - Start logging calls to the trace named by out_tmpl
+ *     (the raw log itself is created by the first flush)
+ */
+static void start_recording(void)
+{
+	char *p = out_path, *t;
+
+	for (t = out_tmpl; *t && p < out_path + MAXPATH - 16; t++)
+	{
+		if (t[0] == '%' && t[1] == 'p')
+		{
+			p += sprintf(p, "%d", (int)getpid());
+			t++;
+		}
+		else
+			*p++ = *t;
+	}
+	*p = '\0';
+	snprintf(raw_path, MAXPATH, "%.*s.raw", MAXPATH - 8, out_path);
+	raw_fd = -1;
+	recording = 1;
+}
+
+/*
+ * fork_child - A forked child records into a trace of its own
+ */
+static void fork_child(void)
+{
+	evbuf_t *b;
+
+	recording = 0;
+	for (b = all_bufs; b != NULL; b = b->next)
+		b->count = 0; /* those events belong to the parent */
+	if (raw_fd >= 0)
+		close(raw_fd);
+	pthread_mutex_init(&raw_lock, NULL);
+	pthread_mutex_init(&bufs_lock, NULL);
+	__atomic_store_n(&next_seq, 0, __ATOMIC_SEQ_CST);
+	start_recording();
+}
+
+__attribute__((constructor))
+static void record_init(void)
+{
+	const char *env = getenv("MM_RECORD_FILE");
+
+	with_meta = getenv("MM_RECORD_META") != NULL;
+	keep_raw = getenv("MM_RECORD_RAW") != NULL;
+	pthread_key_create(&buf_key, thread_exit);
+	pthread_atfork(NULL, NULL, fork_child);
+	snprintf(out_tmpl, MAXPATH, "%s", (env && *env) ? env : "mm-%p.rep");
+	start_recording();
+
+	/* Children (forked or exec'd) must not overwrite our trace */
+	if (strstr(out_tmpl, "%p") == NULL)
+	{
+		snprintf(out_tmpl, MAXPATH, "%.*s.%%p", MAXPATH - 8, out_path);
+		setenv("MM_RECORD_FILE", out_tmpl, 1);
+	}
+}
+
+__attribute__((destructor))
+static void record_fini(void)
+{
+	evbuf_t *b;
+
+	if (!recording)
+		return;
+	recording = 0;
+	pthread_mutex_lock(&bufs_lock);
+	for (b = all_bufs; b != NULL; b = b->next)
+		flush_buf(b);
+	pthread_mutex_unlock(&bufs_lock);
+	write_trace();
+	if (raw_fd >= 0)
+	{
+		close(raw_fd);
+		if (!keep_raw)
+			unlink(raw_path);
+	}
+	raw_fd = -1;
+}
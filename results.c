@@ -0,0 +1,324 @@
+/*
+ * results.c - Write mdriver results in a machine-readable form (JSON or
+ *     CSV), and compare a run against the results file of an earlier
+ *     run so that allocator changes can be gated on measured performance.
+ *
+ * The JSON writer puts each trace on a line of its own, which is what
+ * lets the loader below get away without a general JSON parser: it
+ * only ever reads files that write_results produced.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "results.h"
+
+#define MAXLINE 4096 /* max line length in a results file */
+
+/*
+ * How far the running time of a trace drifts from one mdriver process
+ * to the next (heap placement, caches, clock speed), as a fraction of
+ * it. The samples of a single run can't see this, so compare_results
+ * widens both confidence intervals by it. Short traces (well under a
+ * millisecond) drift 15-40% on a busy machine.
+ */
+#define RUN_DRIFT 0.2
+
+/* One trace record loaded from a baseline results file */
+typedef struct
+{
+	char name[MAXLINE];
+	int valid;
+	double ops;
+	double secs;
+	double ci;
+	double util;
+} base_t;
+
+/*
+ * is_csv - Does path name a CSV file?
+ */
+static int is_csv(const char *path)
+{
+	size_t len = strlen(path);
+	return len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+}
+
+/*
+ * write_results - Write the per-trace stats and the perf index to path
+ */
+int write_results(const char *path, char **tracefiles, int n,
+				  stats_t *stats, double perfindex)
+{
+	FILE *fp;
+	int i;
+	const char *p;
+
+	if ((fp = fopen(path, "w")) == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+
+	if (is_csv(path))
+	{
+		fprintf(fp, "trace,valid,ops,secs,ci,util,kops,avg_util,peak_frag\n");
+		for (i = 0; i < n; i++)
+			fprintf(fp, "%s,%d,%.0f,%.9f,%.9f,%.6f,%.3f,%.6f,%.6f\n",
+					tracefiles[i], stats[i].valid, stats[i].ops,
+					stats[i].secs, stats[i].ci, stats[i].util,
+					stats[i].valid ? (stats[i].ops / 1e3) / stats[i].secs : 0,
+					stats[i].avg_util, stats[i].peak_frag);
+	}
+	else
+	{
+		fprintf(fp, "{\n\"perfindex\": %.2f,\n\"traces\": [\n", perfindex);
+		for (i = 0; i < n; i++)
+		{
+			fprintf(fp, "{\"trace\": \"");
+			for (p = tracefiles[i]; *p; p++)
+			{
+				if (*p == '"' || *p == '\\')
+					fputc('\\', fp);
+				fputc(*p, fp);
+			}
+			fprintf(fp, "\", \"valid\": %d, \"ops\": %.0f, \"secs\": %.9f, "
+						"\"ci\": %.9f, \"util\": %.6f, \"kops\": %.3f, "
+						"\"avg_util\": %.6f, \"peak_frag\": %.6f}%s\n",
+					stats[i].valid, stats[i].ops, stats[i].secs, stats[i].ci,
+					stats[i].util,
+					stats[i].valid ? (stats[i].ops / 1e3) / stats[i].secs : 0,
+					stats[i].avg_util, stats[i].peak_frag,
+					(i < n - 1) ? "," : "");
+		}
+		fprintf(fp, "]\n}\n");
+	}
+
+	if (fclose(fp) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * json_num - Return the number following "key": in line (0 if absent)
+ */
+static double json_num(const char *line, const char *key)
+{
+	char pat[MAXLINE];
+	const char *p;
+
+	sprintf(pat, "\"%s\":", key);
+	if ((p = strstr(line, pat)) == NULL)
+		return 0;
+	return strtod(p + strlen(pat), NULL);
+}
+
+/*
+ * parse_json_line - Fill in b from one trace line of a JSON results file.
+ *     Returns 1 if the line holds a trace record.
+ */
+static int parse_json_line(const char *line, base_t *b)
+{
+	const char *p;
+	char *q = b->name;
+
+	if ((p = strstr(line, "\"trace\":")) == NULL)
+		return 0;
+	if ((p = strchr(p + 8, '"')) == NULL)
+		return 0;
+	for (p++; *p && *p != '"' && q < b->name + MAXLINE - 1; p++)
+	{
+		if (*p == '\\' && p[1])
+			p++;
+		*q++ = *p;
+	}
+	*q = '\0';
+	b->valid = (int)json_num(line, "valid");
+	b->ops = json_num(line, "ops");
+	b->secs = json_num(line, "secs");
+	b->ci = json_num(line, "ci");
+	b->util = json_num(line, "util");
+	return 1;
+}
+
+/*
+ * parse_csv_line - Fill in b from one row of a CSV results file, using
+ *     the column positions col[] found in the header row.
+ */
+enum { C_TRACE, C_VALID, C_OPS, C_SECS, C_CI, C_UTIL, NCOLS };
+static const char *colnames[NCOLS] = {
+	"trace", "valid", "ops", "secs", "ci", "util"};
+
+static int parse_csv_line(char *line, int *col, base_t *b)
+{
+	char *field;
+	int i;
+
+	memset(b, 0, sizeof(*b));
+	for (i = 0, field = strtok(line, ",\n"); field != NULL;
+		 i++, field = strtok(NULL, ",\n"))
+	{
+		if (i == col[C_TRACE])
+		{
+			strncpy(b->name, field, MAXLINE - 1);
+			b->name[MAXLINE - 1] = '\0';
+		}
+		else if (i == col[C_VALID])
+			b->valid = atoi(field);
+		else if (i == col[C_OPS])
+			b->ops = strtod(field, NULL);
+		else if (i == col[C_SECS])
+			b->secs = strtod(field, NULL);
+		else if (i == col[C_CI])
+			b->ci = strtod(field, NULL);
+		else if (i == col[C_UTIL])
+			b->util = strtod(field, NULL);
+	}
+	return b->name[0] != '\0';
+}
+
+/*
+ * load_results - Read a results file written by write_results.
+ *     Returns the number of trace records stored in *basep, or -1.
+ */
+static int load_results(const char *path, base_t **basep)
+{
+	FILE *fp;
+	char line[MAXLINE];
+	base_t *base = NULL;
+	int n = 0, max = 0;
+	int col[NCOLS];
+	int csv = -1;
+	int i;
+
+	if ((fp = fopen(path, "r")) == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, MAXLINE, fp) != NULL)
+	{
+		if (csv < 0)
+		{
+			/* The first line tells the two formats apart */
+			csv = (line[0] != '{');
+			if (csv)
+			{
+				char *field;
+
+				for (i = 0; i < NCOLS; i++)
+					col[i] = -1;
+				for (i = 0, field = strtok(line, ",\n"); field != NULL;
+					 i++, field = strtok(NULL, ",\n"))
+				{
+					int c;
+					for (c = 0; c < NCOLS; c++)
+						if (strcmp(field, colnames[c]) == 0)
+							col[c] = i;
+				}
+				if (col[C_TRACE] < 0)
+				{
+					fprintf(stderr, "%s: not an mdriver results file\n", path);
+					fclose(fp);
+					return -1;
+				}
+				continue;
+			}
+		}
+
+		if (n == max)
+		{
+			max = max ? 2 * max : 16;
+			if ((base = realloc(base, max * sizeof(base_t))) == NULL)
+			{
+				fprintf(stderr, "load_results: realloc failed\n");
+				exit(1);
+			}
+		}
+		if (csv ? parse_csv_line(line, col, &base[n])
+				: parse_json_line(line, &base[n]))
+			n++;
+	}
+	fclose(fp);
+
+	*basep = base;
+	return n;
+}
+
+/*
+ * compare_results - Compare this run against a baseline results file.
+ *     A trace regresses if it was valid and no longer is, if its
+ *     utilization dropped by more than threshold, or if its throughput
+ *     dropped by more than threshold and the two confidence intervals
+ *     of the running time, each widened by RUN_DRIFT, don't overlap (so
+ *     timer noise and run-to-run drift alone can't fail the gate).
+ */
+int compare_results(const char *basepath, char **tracefiles, int n,
+					stats_t *stats, double threshold)
+{
+	base_t *base = NULL;
+	int nbase, i, j;
+	int regressions = 0;
+
+	if ((nbase = load_results(basepath, &base)) < 0)
+		return -1;
+
+	printf("\nComparison against %s (threshold %.1f%%):\n",
+		   basepath, threshold * 100.0);
+	printf("%5s%9s%9s%8s%6s%6s%8s\n",
+		   "trace", "Kops", "base", "delta", "util", "base", "delta");
+	for (i = 0; i < n; i++)
+	{
+		base_t *b = NULL;
+		const char *verdict = "";
+		double kops, bkops, dthru, dutil;
+
+		for (j = 0; j < nbase; j++)
+			if (strcmp(base[j].name, tracefiles[i]) == 0)
+			{
+				b = &base[j];
+				break;
+			}
+
+		if (b == NULL || !b->valid)
+		{
+			printf("%2d%49s\n", i, b == NULL ? "new" : "base invalid");
+			continue;
+		}
+		if (!stats[i].valid)
+		{
+			printf("%2d%49s\n", i, "INVALID  REGRESSION");
+			regressions++;
+			continue;
+		}
+
+		kops = (stats[i].ops / 1e3) / stats[i].secs;
+		bkops = (b->ops / 1e3) / b->secs;
+		dthru = kops / bkops - 1;
+		dutil = (b->util > 0) ? stats[i].util / b->util - 1 : 0;
+
+		/* util is saved with 6 digits; don't flag the rounding */
+		if (dutil < -threshold - 1e-5)
+			verdict = "  UTIL REGRESSION";
+		if (dthru < -threshold &&
+			stats[i].secs * (1 - RUN_DRIFT) - stats[i].ci >
+				b->secs * (1 + RUN_DRIFT) + b->ci)
+			verdict = (*verdict) ? "  UTIL+THRU REGRESSION"
+								 : "  THRU REGRESSION";
+		if (*verdict)
+			regressions++;
+
+		printf("%2d%12.0f%9.0f%+7.1f%%%5.0f%%%5.0f%%%+7.1f%%%s\n",
+			   i, kops, bkops, dthru * 100.0,
+			   stats[i].util * 100.0, b->util * 100.0, dutil * 100.0,
+			   verdict);
+	}
+	printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+
+	free(base);
+	return regressions;
+}
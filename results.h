@@ -0,0 +1,49 @@
+#ifndef __RESULTS_H_
+#define __RESULTS_H_
+
+#include "mm.h"
+#include "latency.h"
+
+/*
+ * results.h - machine-readable mdriver results and baseline comparison
+ */
+
+/* Summarizes the important stats for some malloc function on some trace */
+typedef struct
+{
+	/* defined for both libc malloc and student malloc package (mm.c) */
+	double ops;	 /* number of ops (malloc/free/realloc) in the trace */
+	int valid;	 /* was the trace processed correctly by the allocator? */
+	double secs; /* number of secs needed to run the trace */
+	double ci;	 /* half-width of the 95% confidence interval of secs */
+
+	/* defined only for the student malloc package */
+	double util; /* space utilization for this trace (always 0 for libc) */
+	double avg_util;  /* time-averaged utilization (only with -p) */
+	double peak_frag; /* peak external fragmentation (only with -p) */
+	mm_stats_t counters; /* mm.c event counters of the util pass (MM_STATS) */
+	double moved_bytes;  /* payload bytes of reallocs that moved (util pass) */
+	lat_hist_t lat;		 /* time of each call (only with -L) */
+	double loc_ops;		 /* ops of the replay that touches payloads (-A) */
+	double loc_secs;	 /* its time */
+	double loc_misses;	 /* its cache misses (-1: not counted) */
+	double loc_tlb;		 /* its dTLB read misses (-1: not counted) */
+	double loc_pages;	 /* mean pages holding live blocks */
+	double loc_min_pages; /* mean pages the live bytes need at least */
+
+	/* Note: secs and util are only defined if valid is true */
+} stats_t;
+
+/* Write per-trace stats to path; format is CSV if path ends in ".csv",
+   JSON otherwise. Returns 0 on success, -1 on error. */
+int write_results(const char *path, char **tracefiles, int n,
+				  stats_t *stats, double perfindex);
+
+/* Compare stats against the results file basepath written by an earlier
+   run, print a comparison table and return the number of traces whose
+   throughput or utilization regressed by more than threshold (a fraction),
+   or -1 if basepath can't be read. */
+int compare_results(const char *basepath, char **tracefiles, int n,
+					stats_t *stats, double threshold);
+
+#endif /* __RESULTS_H_ */
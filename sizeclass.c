@@ -0,0 +1,269 @@
+/*
+ * sizeclass.c - Compute size classes from the request sizes in traces
+ *
+ * Reads the traces with read_trace, builds a histogram of the request
+ * sizes (malloc and realloc) rounded up to the 16-byte alignment, and
+ * picks the k class sizes that minimize the expected internal
+ * fragmentation (bytes a request gets beyond what it asked for), by
+ * dynamic programming over the distinct sizes. Requests above the
+ * largest class size (-m) are left out: they keep their plain rounding.
+ *
+ * The output is a header with the classes as a sorted table, which mm.c
+ * rounds its block sizes up to when built with make MM_CLASSES=<file>.
+ *
+ *   unix> sizeclass -k 32 -o mm_classes.h traces/binary-bal.rep traces/cccp-bal.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define ALIGN 16 /* request sizes are rounded up to this first */
+
+int verbose = 0; /* read_trace prints the trace names if > 1 */
+
+/* Histogram of the classed requests, by size in ALIGN units */
+static double *hist;
+static int maxunits;
+
+static void add_trace(trace_t *trace, double *reqbytes, double *over);
+static int make_classes(int k, int *classes);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv)
+{
+	int k = 32, maxsize = 4096;
+	char *outfile = NULL;
+	int *classes;
+	int i, c, n, ntraces;
+	double count = 0, over = 0, reqbytes = 0, classbytes = 0, pow2bytes = 0;
+	size_t p2;
+	FILE *out;
+	trace_t *trace;
+
+	while ((c = getopt(argc, argv, "k:m:o:vh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'k': /* Number of classes */
+			k = atoi(optarg);
+			break;
+		case 'm': /* Largest class size */
+			maxsize = atoi(optarg);
+			break;
+		case 'o': /* Output file */
+			outfile = optarg;
+			break;
+		case 'v': /* Print the trace names */
+			verbose = 2;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (k < 1 || maxsize < ALIGN)
+		app_error("-k must be at least 1 and -m at least 16");
+	if (optind == argc)
+	{
+		usage();
+		exit(1);
+	}
+
+	maxunits = maxsize / ALIGN;
+	if ((hist = calloc(maxunits + 1, sizeof(double))) == NULL ||
+		(classes = malloc(k * sizeof(int))) == NULL)
+		app_error("malloc failed");
+	for (i = optind; i < argc; i++)
+	{
+		trace = read_trace("", argv[i]);
+		add_trace(trace, &reqbytes, &over);
+		free_trace(trace);
+	}
+	ntraces = argc - optind;
+
+	if ((n = make_classes(k, classes)) == 0)
+		app_error("no requests to make classes from");
+
+	/* Expected waste with these classes and with powers of two */
+	for (i = 1, c = 0; i <= maxunits; i++)
+	{
+		if (hist[i] == 0)
+			continue;
+		while (classes[c] < i)
+			c++;
+		for (p2 = ALIGN; p2 < (size_t)i * ALIGN; p2 *= 2)
+			;
+		count += hist[i];
+		classbytes += hist[i] * classes[c] * ALIGN;
+		pow2bytes += hist[i] * p2;
+	}
+
+	if (outfile == NULL)
+		out = stdout;
+	else if ((out = fopen(outfile, "w")) == NULL)
+	{
+		perror(outfile);
+		exit(1);
+	}
+	fprintf(out, "/*\n * %s - size classes made by sizeclass from %d traces\n",
+			outfile ? (strrchr(outfile, '/') ? strrchr(outfile, '/') + 1 : outfile)
+					: "size classes",
+			ntraces);
+	fprintf(out, " *     %d classes for the %.0f of %.0f requests up to %d bytes\n",
+			n, count, count + over, maxunits * ALIGN);
+	fprintf(out, " *     waste per request: %.1f bytes (power-of-two classes: %.1f)\n */\n",
+			(classbytes - reqbytes) / count, (pow2bytes - reqbytes) / count);
+	fprintf(out, "#define MM_NCLASSES %d\n", n);
+	fprintf(out, "static const unsigned int mm_class_size[MM_NCLASSES] = {");
+	for (i = 0; i < n; i++)
+		fprintf(out, "%s%d%s", (i % 8) ? " " : "\n\t", classes[i] * ALIGN,
+				(i < n - 1) ? "," : "\n};\n");
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
+
+/*
+ * add_trace - Count the sizes of the trace's requests in the histogram,
+ *     and add up the bytes the classed ones asked for in *reqbytes and
+ *     the number of bigger ones in *over
+ */
+static void add_trace(trace_t *trace, double *reqbytes, double *over)
+{
+	int i, units;
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		if (trace->ops[i].type == FREE || trace->ops[i].size == 0)
+			continue;
+		units = (trace->ops[i].size + ALIGN - 1) / ALIGN;
+		if (units > maxunits)
+		{
+			(*over)++;
+			continue;
+		}
+		hist[units]++;
+		*reqbytes += trace->ops[i].size;
+	}
+}
+
+/*
+ * make_classes - Choose at most k class sizes (in ALIGN units, sorted)
+ *     from the sizes in the histogram that minimize the total waste,
+ *     and return how many were chosen. Every class is one of the sizes
+ *     and the largest size is always a class, so only the sizes need
+ *     to be tried: cost[j][i] is the least waste of sizes 0..i with j+1
+ *     classes, the last at size i.
+ */
+static int make_classes(int k, int *classes)
+{
+	int *v, n, i, j, t, best;
+	double *w, *cnt, *sum, **cost, c;
+	int **from;
+
+	/* The distinct sizes, and prefix sums of their counts and bytes */
+	if ((v = malloc(maxunits * sizeof(int))) == NULL ||
+		(w = malloc(maxunits * sizeof(double))) == NULL ||
+		(cnt = malloc((maxunits + 1) * sizeof(double))) == NULL ||
+		(sum = malloc((maxunits + 1) * sizeof(double))) == NULL)
+		app_error("malloc failed");
+	for (i = 1, n = 0; i <= maxunits; i++)
+		if (hist[i] > 0)
+		{
+			v[n] = i;
+			w[n++] = hist[i];
+		}
+	if (n == 0)
+		return 0;
+	if (k > n)
+		k = n;
+	cnt[0] = sum[0] = 0;
+	for (i = 0; i < n; i++)
+	{
+		cnt[i + 1] = cnt[i] + w[i];
+		sum[i + 1] = sum[i] + w[i] * v[i];
+	}
+
+	/* Waste of sizes t..i all rounded up to size i */
+#define WASTE(t, i) (v[i] * (cnt[(i) + 1] - cnt[t]) - (sum[(i) + 1] - sum[t]))
+
+	if ((cost = malloc(k * sizeof(double *))) == NULL ||
+		(from = malloc(k * sizeof(int *))) == NULL)
+		app_error("malloc failed");
+	for (j = 0; j < k; j++)
+		if ((cost[j] = malloc(n * sizeof(double))) == NULL ||
+			(from[j] = malloc(n * sizeof(int))) == NULL)
+			app_error("malloc failed");
+	for (i = 0; i < n; i++)
+	{
+		cost[0][i] = WASTE(0, i);
+		from[0][i] = 0;
+	}
+	for (j = 1; j < k; j++)
+		for (i = j; i < n; i++)
+		{
+			/* The class before this one is at size t - 1 */
+			cost[j][i] = -1;
+			for (t = j; t <= i; t++)
+			{
+				c = cost[j - 1][t - 1] + WASTE(t, i);
+				if (cost[j][i] < 0 || c < cost[j][i])
+				{
+					cost[j][i] = c;
+					from[j][i] = t;
+				}
+			}
+		}
+#undef WASTE
+
+	/* Walk back from the largest size */
+	for (j = k - 1, best = n - 1; j >= 0; j--)
+	{
+		classes[j] = v[best];
+		best = from[j][best] - 1;
+	}
+
+	for (j = 0; j < k; j++)
+	{
+		free(cost[j]);
+		free(from[j]);
+	}
+	free(cost);
+	free(from);
+	free(v);
+	free(w);
+	free(cnt);
+	free(sum);
+	return k;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+	fprintf(stderr, "sizeclass: %s\n", msg);
+	exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: sizeclass [-hv] [-k <classes>] [-m <max>] [-o <file>] <trace>...\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+	fprintf(stderr, "\t-k <n>       Number of size classes (default 32).\n");
+	fprintf(stderr, "\t-m <max>     Largest class size; bigger requests aren't classed\n");
+	fprintf(stderr, "\t             (default 4096).\n");
+	fprintf(stderr, "\t-o <file>    Write the header to <file> instead of stdout.\n");
+	fprintf(stderr, "\t-v           Print the name of each trace as it is read.\n");
+}
@@ -0,0 +1,193 @@
+/*
+ * trace.c - Read trace files, whole into memory or one request at a
+ *     time. Split out of mdriver.c so that tools which study the traces
+ *     (sizeclass, tracestat) read them the same way the driver does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+extern int verbose; /* defined by the program */
+
+/*
+ * unix_error - Report a Unix-style error and exit
+ */
+static void unix_error(char *msg)
+{
+	printf("%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+/*
+ * read_uint - Read an unsigned decimal number after any white space;
+ *     returns 0 if there is none
+ */
+static int read_uint(FILE *fp, unsigned *v)
+{
+	int c;
+
+	while ((c = getc_unlocked(fp)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+		;
+	if (c < '0' || c > '9')
+		return 0;
+	*v = 0;
+	do
+		*v = *v * 10 + (c - '0');
+	while ((c = getc_unlocked(fp)) >= '0' && c <= '9');
+	if (c != EOF)
+		ungetc(c, fp);
+	return 1;
+}
+
+/*
+ * trace_open - Open a trace file and read its header
+ */
+void trace_open(trace_stream_t *ts, char *tracedir, char *filename)
+{
+	char msg[MAXLINE + 64];
+
+	if (verbose > 1)
+		printf("Reading tracefile: %s\n", filename);
+	snprintf(ts->path, sizeof(ts->path), "%s%s", tracedir, filename);
+	if ((ts->fp = fopen(ts->path, "r")) == NULL)
+	{
+		snprintf(msg, sizeof(msg), "Could not open %s in trace_open", ts->path);
+		unix_error(msg);
+	}
+	if (fscanf(ts->fp, "%d %d %d %d", &ts->sugg_heapsize, &ts->num_ids,
+			   &ts->num_ops, &ts->weight) != 4)
+	{
+		printf("Bad header in tracefile %s\n", ts->path);
+		exit(1);
+	}
+	ts->op = 0;
+}
+
+/*
+ * trace_next - Read the next request of the trace into op. Returns 1,
+ *     or 0 at the end of the file.
+ */
+int trace_next(trace_stream_t *ts, traceop_t *op)
+{
+	unsigned index, size = 0;
+	int c, type;
+
+	/* The request type is the first letter of a word */
+	while ((c = getc_unlocked(ts->fp)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+		;
+	if (c == EOF)
+		return 0;
+	type = c;
+	while ((c = getc_unlocked(ts->fp)) != EOF && c != ' ' && c != '\t' && c != '\n')
+		;
+
+	switch (type)
+	{
+	case 'a':
+		op->type = ALLOC;
+		break;
+	case 'r':
+		op->type = REALLOC;
+		break;
+	case 'f':
+		op->type = FREE;
+		break;
+	default:
+		printf("Bogus type character (%c) in tracefile %s\n", type, ts->path);
+		exit(1);
+	}
+	if (!read_uint(ts->fp, &index) ||
+		(op->type != FREE && !read_uint(ts->fp, &size)))
+	{
+		printf("Bad request %ld in tracefile %s\n", ts->op, ts->path);
+		exit(1);
+	}
+	op->index = index;
+	op->size = size;
+	ts->op++;
+	return 1;
+}
+
+/*
+ * trace_close - Close a trace file opened by trace_open
+ */
+void trace_close(trace_stream_t *ts)
+{
+	fclose(ts->fp);
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+	trace_stream_t ts;
+	trace_t *trace;
+	traceop_t op;
+	unsigned max_index = 0;
+	unsigned op_index;
+
+	/* Allocate the trace record */
+	if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+		unix_error("malloc 1 failed in read_trace");
+
+	/* Read the trace file header */
+	trace_open(&ts, tracedir, filename);
+	trace->sugg_heapsize = ts.sugg_heapsize; /* not used */
+	trace->num_ids = ts.num_ids;
+	trace->num_ops = ts.num_ops;
+	trace->weight = ts.weight; /* not used */
+
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops =
+			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		unix_error("malloc 2 failed in read_trace");
+
+	/* We'll keep an array of pointers to the allocated blocks here... */
+	if ((trace->blocks =
+			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+		unix_error("malloc 3 failed in read_trace");
+
+	/* ... along with the corresponding byte sizes of each block */
+	if ((trace->block_sizes =
+			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+		unix_error("malloc 4 failed in read_trace");
+
+	/* read every request line in the trace file */
+	op_index = 0;
+	while (trace_next(&ts, &op))
+	{
+		if (op_index == trace->num_ops)
+		{
+			printf("More than %d requests in tracefile %s\n", trace->num_ops,
+				   ts.path);
+			exit(1);
+		}
+		if (op.type != FREE && (unsigned)op.index > max_index)
+			max_index = op.index;
+		trace->ops[op_index++] = op;
+	}
+	trace_close(&ts);
+	assert(max_index == trace->num_ids - 1);
+	assert(trace->num_ops == op_index);
+
+	return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+	free(trace->ops); /* free the three arrays... */
+	free(trace->blocks);
+	free(trace->block_sizes);
+	free(trace); /* and the trace record itself... */
+}
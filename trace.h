@@ -0,0 +1,66 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+
+/*
+ * trace.h - trace files (.rep), read whole or as a stream, shared by
+ *     mdriver and the offline tools
+ */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct
+{
+	enum
+	{
+		ALLOC,
+		FREE,
+		REALLOC
+	} type;	   /* type of request */
+	int index; /* index for free() to use later */
+	int size;  /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct
+{
+	int sugg_heapsize;	 /* suggested heap size (unused) */
+	int num_ids;		 /* number of alloc/realloc ids */
+	int num_ops;		 /* number of distinct requests */
+	int weight;			 /* weight for this trace (unused) */
+	traceop_t *ops;		 /* array of requests */
+	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
+	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+/* A trace file read one request at a time, for traces too big to hold */
+typedef struct
+{
+	FILE *fp;
+	char path[1024];
+	int sugg_heapsize; /* the header, as in trace_t */
+	int num_ids;
+	int num_ops;
+	int weight;
+	long op; /* number of requests read so far */
+} trace_stream_t;
+
+/* Open the trace file tracedir/filename and read its header, printing
+   its name if the program's verbose > 1; exits on error */
+void trace_open(trace_stream_t *ts, char *tracedir, char *filename);
+
+/* Read the next request into op: returns 1, or 0 at the end of the
+   file; exits on a malformed request */
+int trace_next(trace_stream_t *ts, traceop_t *op);
+
+/* Close a trace opened by trace_open */
+void trace_close(trace_stream_t *ts);
+
+/* Read the whole trace file tracedir/filename into memory (as with
+   trace_open); exits on error */
+trace_t *read_trace(char *tracedir, char *filename);
+
+/* Free a trace and its arrays */
+void free_trace(trace_t *trace);
+
+#endif /* __TRACE_H_ */
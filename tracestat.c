@@ -0,0 +1,498 @@
+/*
+ * tracestat.c - Describe the workload in trace files
+ *
+ * For each trace, in one pass over the file (trace_next), reports:
+ *   - the request sizes of mallocs and reallocs (power-of-two buckets)
+ *   - block lifetimes, in ops from malloc to free
+ *   - the peak of live bytes and of live blocks
+ *   - realloc chains: reallocs per block and the growth factor of each
+ *   - phases: runs of windows of -w ops whose sizes and malloc/free mix
+ *     stay close to those of the phase so far
+ *
+ * Only the live blocks are kept (in a hash table on the block id), so
+ * memory is bounded by the peak live block count, not by the length of
+ * the trace.
+ *
+ *   unix> tracestat traces/realloc-bal.rep
+ *   unix> tracestat -w 100000 big.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "trace.h"
+
+#define NBUCKETS 34		/* power-of-two buckets: 0, 1, 2-3, ..., >= 2^32 */
+#define NGROWTH 8		/* growth factor buckets, see growth_bucket */
+#define PHASE_TV 0.5	/* a window whose size mix is this far from the phase... */
+#define PHASE_MIX 0.3	/* ... or whose malloc share is this far, starts a new phase */
+#define MAXSHOWN 50		/* phases printed per trace */
+
+int verbose = 0; /* read_trace prints the trace names if > 1 */
+
+/* A live block */
+typedef struct
+{
+	int id;		  /* block id, -1 if the slot is empty */
+	int reallocs; /* reallocs so far */
+	long size;	  /* current size */
+	long birth;	  /* op of its malloc */
+} live_t;
+
+/* Ops of one window, or of the phase so far */
+typedef struct
+{
+	long start;				/* first op */
+	long ops;				/* number of ops */
+	long mallocs, frees, reallocs;
+	double sizes[NBUCKETS]; /* malloc/realloc sizes */
+	double bytes;			/* bytes asked for by mallocs and reallocs */
+	double live_bytes;		/* live bytes at its end */
+} window_t;
+
+/* Everything gathered about one trace */
+typedef struct
+{
+	long ops, mallocs, frees, reallocs;
+	double malloc_sizes[NBUCKETS], realloc_sizes[NBUCKETS];
+	double lifetimes[NBUCKETS];
+	double chains[NBUCKETS]; /* reallocs per block, at its free */
+	double growth[NGROWTH];
+	double log_growth;		 /* sum of log2(new / old) for the mean */
+	double live_bytes, peak_bytes;
+	long live, peak_blocks, peak_bytes_op, peak_blocks_op;
+	long nphases;
+} tstat_t;
+
+/* The hash table of live blocks (linear probing, power-of-two size) */
+static live_t *table;
+static long table_size, table_used;
+
+static void analyze(char *path, long window);
+static live_t *live_find(int id);
+static live_t *live_add(int id);
+static void live_remove(live_t *b);
+static int bucket(double x);
+static int growth_bucket(double ratio);
+static void end_window(tstat_t *st, window_t *w, window_t *phase);
+static void print_phase(tstat_t *st, window_t *phase);
+static void print_hist(char *title, char *col1, double *h1, char *col2,
+					   double *h2, int n, char **labels);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv)
+{
+	long window = 0;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "w:vh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'w': /* Ops per phase window */
+			window = atol(optarg);
+			break;
+		case 'v': /* Print the trace names */
+			verbose = 2;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind == argc)
+	{
+		usage();
+		exit(1);
+	}
+	for (i = optind; i < argc; i++)
+		analyze(argv[i], window);
+	return 0;
+}
+
+/*
+ * analyze - Read one trace and print its report. The phase window is
+ *     window ops, or 1/100 of the trace (at least 1000 ops) if 0.
+ */
+static void analyze(char *path, long window)
+{
+	static char *size_labels[NBUCKETS], *growth_labels[NGROWTH] = {
+		"< 0.5", "0.5-1", "1", "1-1.25", "1.25-1.5", "1.5-2", "2-4", ">= 4"};
+	static char label_buf[NBUCKETS][32];
+	trace_stream_t ts;
+	traceop_t op;
+	tstat_t st;
+	window_t w, phase;
+	live_t *b;
+	int i;
+
+	if (size_labels[0] == NULL)
+		for (i = 0; i < NBUCKETS; i++)
+		{
+			if (i < 2)
+				snprintf(label_buf[i], sizeof(label_buf[i]), "%d", i);
+			else if (i < NBUCKETS - 1)
+				snprintf(label_buf[i], sizeof(label_buf[i]), "%lu-%lu",
+						 1UL << (i - 1), (1UL << i) - 1);
+			else
+				snprintf(label_buf[i], sizeof(label_buf[i]), ">= %lu", 1UL << (i - 1));
+			size_labels[i] = label_buf[i];
+		}
+
+	trace_open(&ts, "", path);
+	if (window <= 0)
+		window = (ts.num_ops / 100 > 1000) ? ts.num_ops / 100 : 1000;
+	memset(&st, 0, sizeof(st));
+	memset(&w, 0, sizeof(w));
+	memset(&phase, 0, sizeof(phase));
+	table_used = 0;
+	if (table == NULL)
+	{
+		table_size = 1024;
+		if ((table = malloc(table_size * sizeof(live_t))) == NULL)
+			app_error("malloc failed");
+	}
+	for (i = 0; i < table_size; i++)
+		table[i].id = -1;
+
+	printf("%s: %d ops, %d ids\n", path, ts.num_ops, ts.num_ids);
+	printf("\nPhases (windows of %ld ops):\n", window);
+	printf("%12s %12s %9s %9s %9s %10s %14s\n", "first op", "ops", "mallocs",
+		   "frees", "reallocs", "avg size", "live bytes");
+
+	while (trace_next(&ts, &op))
+	{
+		switch (op.type)
+		{
+		case ALLOC:
+			st.mallocs++;
+			w.mallocs++;
+			st.malloc_sizes[bucket(op.size)]++;
+			w.sizes[bucket(op.size)]++;
+			w.bytes += op.size;
+			b = live_add(op.index);
+			b->size = op.size;
+			b->birth = st.ops;
+			b->reallocs = 0;
+			st.live++;
+			st.live_bytes += op.size;
+			break;
+		case REALLOC:
+			st.reallocs++;
+			w.reallocs++;
+			st.realloc_sizes[bucket(op.size)]++;
+			w.sizes[bucket(op.size)]++;
+			w.bytes += op.size;
+			if ((b = live_find(op.index)) == NULL)
+			{
+				/* realloc of a block that isn't live is a malloc */
+				b = live_add(op.index);
+				b->size = 0;
+				b->birth = st.ops;
+				b->reallocs = 0;
+				st.live++;
+			}
+			else if (b->size > 0 && op.size > 0)
+			{
+				st.growth[growth_bucket((double)op.size / b->size)]++;
+				st.log_growth += log2((double)op.size / b->size);
+			}
+			st.live_bytes += op.size - b->size;
+			b->size = op.size;
+			b->reallocs++;
+			break;
+		case FREE:
+			st.frees++;
+			w.frees++;
+			if ((b = live_find(op.index)) == NULL)
+				break;
+			st.lifetimes[bucket(st.ops - b->birth)]++;
+			st.chains[bucket(b->reallocs)]++;
+			st.live--;
+			st.live_bytes -= b->size;
+			live_remove(b);
+			break;
+		}
+		if (st.live_bytes > st.peak_bytes)
+		{
+			st.peak_bytes = st.live_bytes;
+			st.peak_bytes_op = st.ops;
+		}
+		if (st.live > st.peak_blocks)
+		{
+			st.peak_blocks = st.live;
+			st.peak_blocks_op = st.ops;
+		}
+		st.ops++;
+		if (++w.ops == window)
+		{
+			w.live_bytes = st.live_bytes;
+			end_window(&st, &w, &phase);
+			memset(&w, 0, sizeof(w));
+			w.start = st.ops;
+		}
+	}
+	if (w.ops > 0)
+	{
+		w.live_bytes = st.live_bytes;
+		end_window(&st, &w, &phase);
+	}
+	if (phase.ops > 0)
+		print_phase(&st, &phase);
+	if (st.nphases > MAXSHOWN)
+		printf("%12s (%ld phases in all)\n", "...", st.nphases);
+	trace_close(&ts);
+
+	/* Blocks still live at the end never got a lifetime */
+	for (i = 0; i < table_size; i++)
+		if (table[i].id >= 0)
+			st.chains[bucket(table[i].reallocs)]++;
+
+	printf("\nOps: %ld mallocs, %ld frees, %ld reallocs\n", st.mallocs,
+		   st.frees, st.reallocs);
+	printf("Peak live bytes:  %.0f at op %ld\n", st.peak_bytes, st.peak_bytes_op);
+	printf("Peak live blocks: %ld at op %ld\n", st.peak_blocks, st.peak_blocks_op);
+	printf("Never freed: %ld blocks, %.0f bytes\n", st.live, st.live_bytes);
+	print_hist("Request sizes (bytes)", "mallocs", st.malloc_sizes, "reallocs",
+			   st.realloc_sizes, NBUCKETS, size_labels);
+	print_hist("Lifetimes (ops from malloc to free)", "blocks", st.lifetimes,
+			   NULL, NULL, NBUCKETS, size_labels);
+	print_hist("Realloc chains (reallocs per block)", "blocks", st.chains,
+			   NULL, NULL, NBUCKETS, size_labels);
+	print_hist("Realloc growth (new size / old size)", "reallocs", st.growth,
+			   NULL, NULL, NGROWTH, growth_labels);
+	for (i = 0, w.bytes = 0; i < NGROWTH; i++)
+		w.bytes += st.growth[i];
+	if (w.bytes > 0)
+		printf("Mean growth factor: %.3f\n", exp2(st.log_growth / w.bytes));
+	printf("\n");
+}
+
+/*
+ * end_window - Add a finished window to the current phase, unless it
+ *     differs from the phase in the distribution of request sizes (total
+ *     variation distance above PHASE_TV) or in the share of mallocs
+ *     among mallocs and frees (by more than PHASE_MIX). Then the phase
+ *     is printed and the window starts a new one.
+ */
+static void end_window(tstat_t *st, window_t *w, window_t *phase)
+{
+	double wn = 0, pn = 0, tv = 0, wmix, pmix;
+	int i;
+
+	if (phase->ops == 0)
+	{
+		*phase = *w;
+		return;
+	}
+	for (i = 0; i < NBUCKETS; i++)
+	{
+		wn += w->sizes[i];
+		pn += phase->sizes[i];
+	}
+	if (wn > 0 && pn > 0)
+		for (i = 0; i < NBUCKETS; i++)
+			tv += fabs(w->sizes[i] / wn - phase->sizes[i] / pn) / 2;
+	wmix = (w->mallocs + w->frees)
+			   ? (double)w->mallocs / (w->mallocs + w->frees) : 0.5;
+	pmix = (phase->mallocs + phase->frees)
+			   ? (double)phase->mallocs / (phase->mallocs + phase->frees) : 0.5;
+
+	if (tv > PHASE_TV || fabs(wmix - pmix) > PHASE_MIX)
+	{
+		print_phase(st, phase);
+		*phase = *w;
+		return;
+	}
+	phase->ops += w->ops;
+	phase->mallocs += w->mallocs;
+	phase->frees += w->frees;
+	phase->reallocs += w->reallocs;
+	for (i = 0; i < NBUCKETS; i++)
+		phase->sizes[i] += w->sizes[i];
+	phase->bytes += w->bytes;
+	phase->live_bytes = w->live_bytes;
+}
+
+/*
+ * print_phase - Print a row of the phase table (only the first MAXSHOWN)
+ */
+static void print_phase(tstat_t *st, window_t *phase)
+{
+	long n = phase->mallocs + phase->reallocs;
+
+	if (++st->nphases > MAXSHOWN)
+		return;
+	printf("%12ld %12ld %9ld %9ld %9ld %10.0f %14.0f\n", phase->start,
+		   phase->ops, phase->mallocs, phase->frees, phase->reallocs,
+		   n ? phase->bytes / n : 0, phase->live_bytes);
+}
+
+/*
+ * live_find - The live block with this id, or NULL
+ */
+static live_t *live_find(int id)
+{
+	long i = ((unsigned long)id * 0x9E3779B97F4A7C15UL) & (table_size - 1);
+
+	while (table[i].id != -1)
+	{
+		if (table[i].id == id)
+			return &table[i];
+		i = (i + 1) & (table_size - 1);
+	}
+	return NULL;
+}
+
+/*
+ * live_add - Make a slot for the block id, doubling the table when it
+ *     gets half full
+ */
+static live_t *live_add(int id)
+{
+	live_t *old;
+	long i, n;
+
+	if (2 * (table_used + 1) > table_size)
+	{
+		old = table;
+		n = table_size;
+		table_size *= 2;
+		if ((table = malloc(table_size * sizeof(live_t))) == NULL)
+			app_error("malloc failed");
+		for (i = 0; i < table_size; i++)
+			table[i].id = -1;
+		table_used = 0;
+		for (i = 0; i < n; i++)
+			if (old[i].id != -1)
+				*live_add(old[i].id) = old[i];
+		free(old);
+	}
+	i = ((unsigned long)id * 0x9E3779B97F4A7C15UL) & (table_size - 1);
+	while (table[i].id != -1)
+		i = (i + 1) & (table_size - 1);
+	table[i].id = id;
+	table_used++;
+	return &table[i];
+}
+
+/*
+ * live_remove - Empty a slot, moving later blocks of the same probe run
+ *     back so that live_find still reaches them
+ */
+static void live_remove(live_t *b)
+{
+	long i = b - table, j = i, k;
+
+	for (;;)
+	{
+		j = (j + 1) & (table_size - 1);
+		if (table[j].id == -1)
+			break;
+		k = ((unsigned long)table[j].id * 0x9E3779B97F4A7C15UL) & (table_size - 1);
+		/* move j to i unless its home k lies cyclically in (i, j] */
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		table[i] = table[j];
+		i = j;
+	}
+	table[i].id = -1;
+	table_used--;
+}
+
+/*
+ * bucket - Power-of-two bucket of x: 0 for 0, 1 for 1, b for
+ *     2^(b-1) .. 2^b - 1
+ */
+static int bucket(double x)
+{
+	int b = 0;
+
+	while (x >= 1 && b < NBUCKETS - 1)
+	{
+		x /= 2;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * growth_bucket - Bucket of a realloc's new size / old size
+ */
+static int growth_bucket(double ratio)
+{
+	if (ratio < 0.5)
+		return 0;
+	if (ratio < 1)
+		return 1;
+	if (ratio == 1)
+		return 2;
+	if (ratio < 1.25)
+		return 3;
+	if (ratio < 1.5)
+		return 4;
+	if (ratio < 2)
+		return 5;
+	if (ratio < 4)
+		return 6;
+	return 7;
+}
+
+/*
+ * print_hist - Print one or two histograms side by side, skipping the
+ *     empty rows
+ */
+static void print_hist(char *title, char *col1, double *h1, char *col2,
+					   double *h2, int n, char **labels)
+{
+	double t1 = 0, t2 = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		t1 += h1[i];
+		t2 += h2 ? h2[i] : 0;
+	}
+	if (t1 + t2 == 0)
+		return;
+	printf("\n%s:\n%24s %12s %6s", title, "", col1, "%");
+	if (h2)
+		printf(" %12s %6s", col2, "%");
+	printf("\n");
+	for (i = 0; i < n; i++)
+	{
+		if (h1[i] == 0 && (h2 == NULL || h2[i] == 0))
+			continue;
+		printf("%24s %12.0f %6.1f", labels[i], h1[i], t1 ? 100.0 * h1[i] / t1 : 0);
+		if (h2)
+			printf(" %12.0f %6.1f", h2[i], t2 ? 100.0 * h2[i] / t2 : 0);
+		printf("\n");
+	}
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+	fprintf(stderr, "tracestat: %s\n", msg);
+	exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracestat [-hv] [-w <ops>] <trace>...\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+	fprintf(stderr, "\t-w <ops>     Ops per phase window (default 1/100 of the trace).\n");
+	fprintf(stderr, "\t-v           Print the name of each trace as it is read.\n");
+}